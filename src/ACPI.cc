@@ -0,0 +1,260 @@
+/* ACPI.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Finding and parsing ACPI tables.
+ */
+
+#include "ACPI.hh"
+
+namespace {
+
+/** The MADT: an SDT header, then a list of variable-length entries. */
+struct PACKED MADT
+{
+    acpi::SDTHeader header;
+    u32 localAPICAddress;
+    u32 flags;
+};
+
+/** MADT flags. */
+enum MADTFlags {
+    PCATCompatible = 1 << 0,    // There are 8259 PICs as well.
+};
+
+struct PACKED MADTEntry
+{
+    enum class Type : u8 {
+        LocalAPIC = 0,
+        IOAPIC = 1,
+        InterruptSourceOverride = 2,
+        LocalAPICAddressOverride = 5,
+    };
+
+    Type type;
+    u8 length;
+};
+
+struct PACKED MADTLocalAPIC
+{
+    MADTEntry entry;
+    u8 processorId;
+    u8 apicId;
+    u32 flags;              // Bit 0: processor is enabled
+};
+
+struct PACKED MADTIOAPIC
+{
+    MADTEntry entry;
+    u8 id;
+    u8 reserved;
+    u32 address;
+    u32 interruptBase;
+};
+
+struct PACKED MADTInterruptSourceOverride
+{
+    MADTEntry entry;
+    u8 bus;                 // Always 0, ISA
+    u8 source;              // ISA IRQ
+    u32 globalInterrupt;
+    u16 flags;              // MPS INTI flags
+};
+
+struct PACKED MADTLocalAPICAddressOverride
+{
+    MADTEntry entry;
+    u16 reserved;
+    u64 address;
+};
+
+/** MPS INTI flags, used by interrupt source overrides. */
+enum INTIFlags {
+    PolarityMask = 0x3,
+    PolarityActiveLow = 0x3,
+    TriggerMask = 0xC,
+    TriggerLevel = 0xC,
+};
+
+
+/** ACPI tables are valid if all their bytes sum to 0. */
+bool
+checksumIsValid(const void* table,
+                usize length)
+{
+    const u8* bytes = static_cast<const u8*>(table);
+    u8 sum = 0;
+    for (usize i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+
+bool
+signatureMatches(const char* signature,
+                 const char* expected,
+                 usize length)
+{
+    for (usize i = 0; i < length; i++) {
+        if (signature[i] != expected[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Read a `T` at a fixed physical address in the identity-mapped low memory.
+ * The address goes through an empty asm so the compiler can't see it's a
+ * constant; GCC warns about dereferencing small constant pointers.
+ */
+template<typename T>
+inline T
+readPhysical(uptr address)
+{
+    const T* pointer;
+    asm("" : "=r"(pointer) : "0"(address));
+    return *pointer;
+}
+
+
+/** Look for the RSDP in [start, end). It's always on a 16 byte boundary. */
+const acpi::RSDP*
+scanForRSDP(uptr start,
+            uptr end)
+{
+    for (uptr address = start; address < end; address += 16) {
+        auto rsdp = reinterpret_cast<const acpi::RSDP*>(address);
+        if (signatureMatches(rsdp->signature, "RSD PTR ", 8) && checksumIsValid(rsdp, sizeof(acpi::RSDP))) {
+            return rsdp;
+        }
+    }
+    return nullptr;
+}
+
+} /* anonymous namespace */
+
+namespace acpi {
+
+/*
+ * Static
+ */
+
+const RSDP*
+RSDP::find()
+{
+    // The first KB of the Extended BIOS Data Area. Its segment is stored in
+    // the BIOS Data Area at 0x40E.
+    const uptr ebda = uptr(readPhysical<u16>(0x40E)) << 4;
+    if (ebda) {
+        auto rsdp = scanForRSDP(ebda, ebda + 1024);
+        if (rsdp) {
+            return rsdp;
+        }
+    }
+    // The BIOS read-only area.
+    return scanForRSDP(0xE0000, 0x100000);
+}
+
+
+const SDTHeader*
+SDTHeader::find(const RSDP& rsdp,
+                const char* signature)
+{
+    auto rsdt = reinterpret_cast<const SDTHeader*>(rsdp.rsdtAddress);
+    if (!rsdt || !checksumIsValid(rsdt, rsdt->length)) {
+        return nullptr;
+    }
+
+    // The RSDT header is followed by an array of 32-bit table addresses.
+    auto tables = reinterpret_cast<const u32*>(rsdt + 1);
+    const usize count = (rsdt->length - sizeof(SDTHeader)) / sizeof(u32);
+    for (usize i = 0; i < count; i++) {
+        auto table = reinterpret_cast<const SDTHeader*>(tables[i]);
+        if (signatureMatches(table->signature, signature, 4) && checksumIsValid(table, table->length)) {
+            return table;
+        }
+    }
+    return nullptr;
+}
+
+/*
+ * Public
+ */
+
+bool
+InterruptConfiguration::load()
+{
+    auto rsdp = RSDP::find();
+    if (!rsdp) {
+        return false;
+    }
+    auto madt = reinterpret_cast<const MADT*>(SDTHeader::find(*rsdp, "APIC"));
+    if (!madt) {
+        return false;
+    }
+
+    localAPICAddress = madt->localAPICAddress;
+    hasPIC = (madt->flags & PCATCompatible) != 0;
+    numberOfProcessors = 0;
+    numberOfIOAPICs = 0;
+    for (usize i = 0; i < ISAInterruptCount; i++) {
+        // ISA interrupts are edge triggered and active high unless overridden.
+        isaInterrupts[i] = {u32(i), false, false};
+    }
+
+    const uptr end = uptr(madt) + madt->header.length;
+    uptr address = uptr(madt + 1);
+    while (address + sizeof(MADTEntry) <= end) {
+        auto entry = reinterpret_cast<const MADTEntry*>(address);
+        if (entry->length < sizeof(MADTEntry)) {
+            // Malformed. Don't loop forever.
+            break;
+        }
+
+        switch (entry->type) {
+            case MADTEntry::Type::LocalAPIC: {
+                auto lapic = reinterpret_cast<const MADTLocalAPIC*>(entry);
+                if ((lapic->flags & 0x1) && numberOfProcessors < x86::MaxCPUs) {
+                    processorAPICIds[numberOfProcessors++] = lapic->apicId;
+                }
+                break;
+            }
+            case MADTEntry::Type::IOAPIC: {
+                auto ioapic = reinterpret_cast<const MADTIOAPIC*>(entry);
+                if (numberOfIOAPICs < MaxIOAPICs) {
+                    ioAPICs[numberOfIOAPICs++] = {ioapic->id, ioapic->address, ioapic->interruptBase};
+                }
+                break;
+            }
+            case MADTEntry::Type::InterruptSourceOverride: {
+                auto sourceOverride = reinterpret_cast<const MADTInterruptSourceOverride*>(entry);
+                if (sourceOverride->source < ISAInterruptCount) {
+                    auto& isa = isaInterrupts[sourceOverride->source];
+                    isa.globalInterrupt = sourceOverride->globalInterrupt;
+                    isa.isActiveLow = (sourceOverride->flags & PolarityMask) == PolarityActiveLow;
+                    isa.isLevelTriggered = (sourceOverride->flags & TriggerMask) == TriggerLevel;
+                }
+                break;
+            }
+            case MADTEntry::Type::LocalAPICAddressOverride: {
+                auto addressOverride = reinterpret_cast<const MADTLocalAPICAddressOverride*>(entry);
+                // Only reachable if it's below 4 GB.
+                if (addressOverride->address < (u64(1) << 32)) {
+                    localAPICAddress = u32(addressOverride->address);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        address += entry->length;
+    }
+
+    return numberOfProcessors > 0;
+}
+
+} /* namespace acpi */
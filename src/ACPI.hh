@@ -0,0 +1,104 @@
+/* ACPI.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Just enough ACPI to find the interrupt controllers and processors: the RSDP,
+ * the RSDT, and the Multiple APIC Description Table (MADT).
+ *
+ * All tables are read through their physical addresses, so this has to run
+ * before paging is turned on, or with the tables identity mapped.
+ */
+
+#ifndef __ACPI_HH__
+#define __ACPI_HH__
+
+#include "Attributes.hh"
+#include "CPU.hh"
+#include "kstd/Types.hh"
+
+namespace acpi {
+
+/** Root System Description Pointer. Found by scanning low memory. */
+struct PACKED RSDP
+{
+    char signature[8];
+    u8 checksum;
+    char oemId[6];
+    u8 revision;
+    u32 rsdtAddress;
+
+    /** Find the RSDP in the EBDA or the BIOS area. Returns null if there isn't one. */
+    static const RSDP* find();
+};
+
+
+/** The header every System Description Table starts with. */
+struct PACKED SDTHeader
+{
+    char signature[4];
+    u32 length;
+    u8 revision;
+    u8 checksum;
+    char oemId[6];
+    char oemTableId[8];
+    u32 oemRevision;
+    u32 creatorId;
+    u32 creatorRevision;
+
+    /** Find the table with `signature` via the RSDT. Returns null if there isn't one. */
+    static const SDTHeader* find(const RSDP& rsdp, const char* signature);
+};
+
+
+/** An I/O APIC, as described by the MADT. */
+struct IOAPICDescription
+{
+    u8 id;
+    u32 address;
+    /** First global system interrupt this I/O APIC handles. */
+    u32 interruptBase;
+};
+
+
+/** Where a legacy ISA IRQ is wired to, as described by the MADT. */
+struct ISAInterrupt
+{
+    /** Global system interrupt the IRQ is connected to. */
+    u32 globalInterrupt;
+    bool isActiveLow;
+    bool isLevelTriggered;
+};
+
+
+/** Everything in the MADT that the kernel cares about. */
+struct InterruptConfiguration
+{
+    static const usize MaxIOAPICs = 4;
+    static const usize ISAInterruptCount = 16;
+
+    /** Physical address of the local APICs. */
+    u32 localAPICAddress;
+    /** `true` if there's also a pair of 8259 PICs that have to be masked. */
+    bool hasPIC;
+
+    /** Local APIC IDs of the enabled processors. */
+    u8 processorAPICIds[x86::MaxCPUs];
+    usize numberOfProcessors;
+
+    IOAPICDescription ioAPICs[MaxIOAPICs];
+    usize numberOfIOAPICs;
+
+    /** Legacy IRQs, by IRQ number. Identity mapped unless the MADT overrides them. */
+    ISAInterrupt isaInterrupts[ISAInterruptCount];
+
+    /**
+     * Find and parse the MADT.
+     * @return `false` if there's no ACPI, or no MADT.
+     */
+    bool load();
+};
+
+} /* namespace acpi */
+
+#endif /* __ACPI_HH__ */
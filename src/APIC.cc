@@ -0,0 +1,264 @@
+/* APIC.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Local APIC and I/O APIC drivers.
+ */
+
+#include "APIC.hh"
+#include "CPU.hh"
+
+namespace {
+
+/** IA32_APIC_BASE model-specific register. */
+const u32 APICBaseMSR = 0x1B;
+const u64 APICBaseEnable = 1 << 11;
+
+/** CPUID.1:EDX bit saying there's a Local APIC. */
+const u32 CPUIDAPICFeature = 1 << 9;
+
+/** Spurious interrupt vector register: software enable bit. */
+const u32 APICSoftwareEnable = 1 << 8;
+
+/** Interrupt command register bits, low word. */
+enum InterruptCommand {
+    DeliveryPending = 1 << 12,
+    LevelAssert = 1 << 14,
+};
+
+/** I/O APIC registers, reached indirectly through IOREGSEL and IOWIN. */
+enum IOAPICRegister {
+    IOAPICVersion = 0x01,
+    IOAPICRedirectionTable = 0x10,     // Two registers per entry
+};
+
+/** Redirection table entry bits, low word. */
+enum RedirectionEntry {
+    ActiveLow = 1 << 13,
+    LevelTriggered = 1 << 15,
+    Masked = 1 << 16,
+};
+
+} /* anonymous namespace */
+
+namespace x86 {
+
+/*
+ * Static
+ */
+
+bool
+LocalAPIC::isPresent()
+{
+    return (cpuid(1).edx & CPUIDAPICFeature) != 0;
+}
+
+/*
+ * Public
+ */
+
+LocalAPIC::LocalAPIC()
+    : mBase(nullptr)
+{ }
+
+
+void
+LocalAPIC::initialize(uptr base,
+                      u8 spuriousVector,
+                      u8 errorVector)
+{
+    // Make sure the APIC is globally enabled and at the address we expect.
+    writeMSR(APICBaseMSR, (readMSR(APICBaseMSR) & 0xFFF) | (base & ~uptr(0xFFF)) | APICBaseEnable);
+    mBase = reinterpret_cast<volatile u32*>(base);
+
+    write(Register::LVTTimer, LVTMasked);
+    write(Register::LVTLINT0, LVTMasked);
+    write(Register::LVTLINT1, LVTMasked);
+    write(Register::LVTError, errorVector);
+    // Writing ESR latches the current errors; do it twice to clear them.
+    write(Register::ErrorStatus, 0);
+    write(Register::ErrorStatus, 0);
+
+    setTaskPriority(0);
+    write(Register::SpuriousInterruptVector, APICSoftwareEnable | spuriousVector);
+
+    // Clear anything left in service from before we took over.
+    endOfInterrupt();
+}
+
+
+u8
+LocalAPIC::id()
+    const
+{
+    return read(Register::ID) >> 24;
+}
+
+
+void
+LocalAPIC::startTimer(u8 vector,
+                      TimerMode mode,
+                      u32 count)
+    const
+{
+    write(Register::TimerDivideConfiguration, 0x3);    // Divide by 16
+    write(Register::LVTTimer, u32(mode) | vector);
+    write(Register::TimerInitialCount, count);
+}
+
+
+void
+LocalAPIC::sendInterprocessorInterrupt(u8 destination,
+                                       DeliveryMode mode,
+                                       u8 vector)
+    const
+{
+    sendCommand(u32(destination) << 24, LevelAssert | u32(mode) | vector);
+}
+
+
+void
+LocalAPIC::sendInterprocessorInterrupt(Shorthand destination,
+                                       DeliveryMode mode,
+                                       u8 vector)
+    const
+{
+    sendCommand(0, u32(destination) | LevelAssert | u32(mode) | vector);
+}
+
+
+u32
+LocalAPIC::read(Register reg)
+    const
+{
+    return mBase[u32(reg) / sizeof(u32)];
+}
+
+
+void
+LocalAPIC::write(Register reg,
+                 u32 value)
+    const
+{
+    mBase[u32(reg) / sizeof(u32)] = value;
+}
+
+/*
+ * Private
+ */
+
+void
+LocalAPIC::sendCommand(u32 high,
+                       u32 low)
+    const
+{
+    while (read(Register::InterruptCommandLow) & DeliveryPending) {
+        pause();
+    }
+    write(Register::InterruptCommandHigh, high);
+    // Writing the low half sends it.
+    write(Register::InterruptCommandLow, low);
+    while (read(Register::InterruptCommandLow) & DeliveryPending) {
+        pause();
+    }
+}
+
+/*
+ * Public
+ */
+
+IOAPIC::IOAPIC()
+    : mBase(nullptr),
+      mInterruptBase(0),
+      mNumberOfEntries(0),
+      mLock()
+{ }
+
+
+void
+IOAPIC::initialize(uptr base,
+                   u32 interruptBase)
+{
+    mBase = reinterpret_cast<volatile u32*>(base);
+    mInterruptBase = interruptBase;
+
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    // Bits 16:23 of the version register are the index of the last entry.
+    mNumberOfEntries = ((read(IOAPICVersion) >> 16) & 0xFF) + 1;
+
+    for (u32 i = 0; i < mNumberOfEntries; i++) {
+        write(IOAPICRedirectionTable + 2 * i, Masked);
+        write(IOAPICRedirectionTable + 2 * i + 1, 0);
+    }
+}
+
+
+void
+IOAPIC::route(u32 gsi,
+              u8 vector,
+              u8 destination,
+              bool activeLow,
+              bool levelTriggered)
+{
+    if (!handles(gsi)) {
+        return;
+    }
+    const u8 reg = IOAPICRedirectionTable + 2 * (gsi - mInterruptBase);
+
+    // Fixed delivery to a physical destination.
+    u32 low = Masked | vector;
+    if (activeLow) {
+        low |= ActiveLow;
+    }
+    if (levelTriggered) {
+        low |= LevelTriggered;
+    }
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    write(reg, Masked);
+    write(reg + 1, u32(destination) << 24);
+    write(reg, low);
+}
+
+
+void
+IOAPIC::setMasked(u32 gsi,
+                  bool masked)
+{
+    if (!handles(gsi)) {
+        return;
+    }
+    const u8 reg = IOAPICRedirectionTable + 2 * (gsi - mInterruptBase);
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    u32 low = read(reg);
+    if (masked) {
+        low |= Masked;
+    } else {
+        low &= ~u32(Masked);
+    }
+    write(reg, low);
+}
+
+/*
+ * Private
+ */
+
+u32
+IOAPIC::read(u8 reg)
+    const
+{
+    mBase[0] = reg;         // IOREGSEL
+    return mBase[4];        // IOWIN, at offset 0x10
+}
+
+
+void
+IOAPIC::write(u8 reg,
+              u32 value)
+    const
+{
+    mBase[0] = reg;
+    mBase[4] = value;
+}
+
+} /* namespace x86 */
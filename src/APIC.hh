@@ -0,0 +1,188 @@
+/* APIC.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * The Advanced Programmable Interrupt Controllers: the Local APIC built into
+ * each CPU, and the I/O APICs that route device interrupts to them. Both are
+ * programmed through memory-mapped registers.
+ */
+
+#ifndef __APIC_HH__
+#define __APIC_HH__
+
+#include "kstd/SpinLock.hh"
+#include "kstd/Types.hh"
+
+namespace x86 {
+
+/**
+ * Each CPU has a Local APIC at the same physical address; accesses go to the
+ * accessing CPU's own APIC. It delivers interrupts to its CPU, takes the EOI
+ * for them, and sends and receives inter-processor interrupts.
+ */
+struct LocalAPIC
+{
+    enum class Register : u32 {
+        ID = 0x020,
+        Version = 0x030,
+        TaskPriority = 0x080,
+        EndOfInterrupt = 0x0B0,
+        SpuriousInterruptVector = 0x0F0,
+        ErrorStatus = 0x280,
+        InterruptCommandLow = 0x300,
+        InterruptCommandHigh = 0x310,
+        LVTTimer = 0x320,
+        LVTLINT0 = 0x350,
+        LVTLINT1 = 0x360,
+        LVTError = 0x370,
+        TimerInitialCount = 0x380,
+        TimerCurrentCount = 0x390,
+        TimerDivideConfiguration = 0x3E0,
+    };
+
+    /** Bit in an LVT entry that masks the interrupt. */
+    static const u32 LVTMasked = 1 << 16;
+
+    /** `true` if the CPU has a Local APIC. */
+    static bool isPresent();
+
+    LocalAPIC();
+
+    /**
+     * Enable the Local APIC at physical address `base` with the given spurious
+     * interrupt vector. The LINT pins and the timer start out masked.
+     */
+    void initialize(uptr base, u8 spuriousVector, u8 errorVector);
+
+    bool isEnabled() const { return mBase != nullptr; }
+
+    /** This CPU's APIC ID. */
+    u8 id() const;
+
+    /** Signal the end of the interrupt in service. */
+    void endOfInterrupt() const { write(Register::EndOfInterrupt, 0); }
+
+    /**
+     * Set the task priority. Interrupts whose priority class (vector / 16) is
+     * at or below `priority` / 16 are held off until it's lowered again.
+     */
+    void setTaskPriority(u8 priority) const { write(Register::TaskPriority, priority); }
+
+    /**
+     * @defgroup Timer
+     * Each Local APIC has a timer that counts down from an initial count at
+     * the bus clock divided by TimerDivisor, and interrupts its own CPU when
+     * it reaches zero.
+     * @{
+     */
+    static const u32 TimerDivisor = 16;
+
+    enum class TimerMode : u32 {
+        OneShot = 0 << 17,
+        Periodic = 1 << 17,
+    };
+
+    /** Start the timer counting down from `count`. A count of 0 stops it. */
+    void startTimer(u8 vector, TimerMode mode, u32 count) const;
+
+    void
+    stopTimer()
+        const
+    {
+        write(Register::LVTTimer, LVTMasked);
+        write(Register::TimerInitialCount, 0);
+    }
+
+    u32 timerCount() const { return read(Register::TimerCurrentCount); }
+    /** @} */
+
+    /**
+     * @defgroup Interprocessor Interrupts
+     * IPIs are sent by writing the destination's APIC ID to the high half of
+     * the interrupt command register, then the vector and delivery mode to
+     * the low half.
+     * @{
+     */
+    enum class DeliveryMode : u32 {
+        /** Interrupt the destination at the given vector. */
+        Fixed = 0 << 8,
+        /** Reset the destination into its wait-for-SIPI state. */
+        INIT = 5 << 8,
+        /** Start the destination in real mode at vector * 0x1000. */
+        Startup = 6 << 8,
+    };
+
+    /** Destinations that don't need an APIC ID. */
+    enum class Shorthand : u32 {
+        Self = 1 << 18,
+        All = 2 << 18,
+        AllButSelf = 3 << 18,
+    };
+
+    /**
+     * Send an IPI to the CPU with APIC ID `destination`, and wait for the
+     * APIC to accept it for delivery.
+     */
+    void sendInterprocessorInterrupt(u8 destination, DeliveryMode mode, u8 vector) const;
+
+    /** Send an IPI to a shorthand destination, all at once. */
+    void sendInterprocessorInterrupt(Shorthand destination, DeliveryMode mode, u8 vector) const;
+    /** @} */
+
+    u32 read(Register reg) const;
+    void write(Register reg, u32 value) const;
+
+private:
+    volatile u32* mBase;
+
+    /** Write the interrupt command register, waiting for it to be free before and after. */
+    void sendCommand(u32 high, u32 low) const;
+};
+
+
+/**
+ * An I/O APIC. Each one handles a range of global system interrupts, and has a
+ * redirection table entry per interrupt saying which vector and CPU it goes to.
+ */
+struct IOAPIC
+{
+    IOAPIC();
+
+    /** Set up the I/O APIC at physical address `base`. Every entry starts out masked. */
+    void initialize(uptr base, u32 interruptBase);
+
+    bool isEnabled() const { return mBase != nullptr; }
+
+    /** `true` if this I/O APIC handles global system interrupt `gsi`. */
+    bool handles(u32 gsi) const { return isEnabled() && gsi >= mInterruptBase && gsi < mInterruptBase + mNumberOfEntries; }
+
+    /**
+     * Route `gsi` to `vector` on the CPU with Local APIC ID `destination`. The
+     * entry is left masked; unmask it with setMasked().
+     */
+    void route(u32 gsi, u8 vector, u8 destination, bool activeLow, bool levelTriggered);
+
+    void setMasked(u32 gsi, bool masked);
+
+private:
+    volatile u32* mBase;
+    u32 mInterruptBase;
+    u32 mNumberOfEntries;
+
+    /**
+     * Held across every register access, from selecting a register in
+     * IOREGSEL to the last access through IOWIN, so another CPU can't select a
+     * different one or change an entry in between.
+     */
+    kstd::SpinLock mLock;
+
+    /** @{ Register access. mLock has to be held. */
+    u32 read(u8 reg) const;
+    void write(u8 reg, u32 value) const;
+    /** @} */
+};
+
+} /* namespace x86 */
+
+#endif /* __APIC_HH__ */
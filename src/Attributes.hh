@@ -15,5 +15,7 @@
 #define PACKED __attribute__((packed))
 #define NORETURN __attribute__((noreturn))
 #define PRINTF(formatArg, variableArgStart) __attribute__((format (printf, formatArg, variableArgStart)))
+/** Put a PerCPU variable in the per-CPU data template. See PerCPU.hh. */
+#define PER_CPU __attribute__((section(".percpu")))
 
 #endif /* __ATTRIBUTES_HH__ */
@@ -0,0 +1,241 @@
+/* CPU.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Small wrappers around x86 instructions that don't belong to any particular
+ * device: flags, interrupt enable, spin-wait hints, the time stamp counter,
+ * bit scans, control registers, TLB invalidation, CPUID, and model-specific
+ * registers.
+ */
+
+#ifndef __CPU_HH__
+#define __CPU_HH__
+
+#include "PerCPU.hh"
+#include "kstd/Types.hh"
+
+namespace x86 {
+
+/** Most CPUs the kernel supports. Sets of CPUs fit in a u32 bit mask. */
+const usize MaxCPUs = 32;
+
+/** Each CPU's number, in its per-CPU data. */
+extern PerCPU<usize> cpuNumber;
+
+/**
+ * Index of the CPU we're running on. The boot CPU is 0; application
+ * processors are numbered as they're started. See SMP.cc.
+ */
+inline usize
+currentCPU()
+{
+    return cpuNumber.load();
+}
+
+/** EFLAGS.IF, the interrupt enable flag. */
+const u32 InterruptFlag = 1 << 9;
+
+/** Read EFLAGS. */
+inline u32
+readFlags()
+{
+    u32 flags;
+    asm volatile("pushfl\n\tpopl %0" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+
+/** `true` if interrupts are enabled on this CPU. */
+inline bool
+interruptsEnabled()
+{
+    return (readFlags() & InterruptFlag) != 0;
+}
+
+
+inline void
+enableInterrupts()
+{
+    asm volatile("sti" : : : "memory");
+}
+
+
+inline void
+disableInterrupts()
+{
+    asm volatile("cli" : : : "memory");
+}
+
+
+/**
+ * Disable interrupts and return the previous value of EFLAGS, so it can be
+ * handed to restoreFlags() later. Calls may nest.
+ */
+inline u32
+saveFlagsAndDisableInterrupts()
+{
+    u32 flags;
+    asm volatile("pushfl\n\tpopl %0\n\tcli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+
+/** Restore the interrupt flag saved by saveFlagsAndDisableInterrupts(). */
+inline void
+restoreFlags(u32 flags)
+{
+    if (flags & InterruptFlag) {
+        enableInterrupts();
+    }
+}
+
+
+/**
+ * Enable interrupts and halt until the next one arrives. `sti` holds off
+ * interrupts until after the next instruction, so there's no window for an
+ * interrupt to sneak in before the `hlt` and leave us sleeping.
+ */
+inline void
+enableInterruptsAndHalt()
+{
+    asm volatile("sti\n\thlt" : : : "memory");
+}
+
+
+/** Spin-wait hint. Tells the CPU we're in a busy loop. */
+inline void
+pause()
+{
+    asm volatile("pause" : : : "memory");
+}
+
+
+/** Read the time stamp counter. */
+inline u64
+rdtsc()
+{
+    u32 low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return (u64(high) << 32) | low;
+}
+
+
+/** Index of the lowest set bit in `value`, which must not be 0. */
+inline u32
+bitScanForward(u32 value)
+{
+    u32 index;
+    asm("bsfl %1, %0" : "=r"(index) : "rm"(value) : "cc");
+    return index;
+}
+
+
+/** Index of the highest set bit in `value`, which must not be 0. */
+inline u32
+bitScanReverse(u32 value)
+{
+    u32 index;
+    asm("bsrl %1, %0" : "=r"(index) : "rm"(value) : "cc");
+    return index;
+}
+
+
+/** @{ Control registers. */
+inline u32
+readCR0()
+{
+    u32 value;
+    asm volatile("movl %%cr0, %0" : "=r"(value));
+    return value;
+}
+
+
+inline void
+writeCR0(u32 value)
+{
+    asm volatile("movl %0, %%cr0" : : "r"(value) : "memory");
+}
+
+
+inline u32
+readCR4()
+{
+    u32 value;
+    asm volatile("movl %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+
+inline void
+writeCR4(u32 value)
+{
+    asm volatile("movl %0, %%cr4" : : "r"(value) : "memory");
+}
+/** @} */
+
+
+/** Clear CR0.TS, so FPU and SSE instructions stop raising #NM. */
+inline void
+clearTaskSwitched()
+{
+    asm volatile("clts" : : : "memory");
+}
+
+
+/** Drop this CPU's TLB entry for the page holding `address`. */
+inline void
+invalidatePage(uptr address)
+{
+    asm volatile("invlpg (%0)" : : "r"(address) : "memory");
+}
+
+
+/** Drop all of this CPU's non-global TLB entries by reloading CR3. */
+inline void
+flushTLB()
+{
+    uptr cr3;
+    asm volatile("movl %%cr3, %0\n\tmovl %0, %%cr3" : "=r"(cr3) : : "memory");
+}
+
+
+struct CPUID
+{
+    u32 eax, ebx, ecx, edx;
+};
+
+/** Execute CPUID for `leaf` and `subleaf`. */
+inline CPUID
+cpuid(u32 leaf,
+      u32 subleaf = 0)
+{
+    CPUID result;
+    asm volatile("cpuid"
+                 : "=a"(result.eax), "=b"(result.ebx), "=c"(result.ecx), "=d"(result.edx)
+                 : "a"(leaf), "c"(subleaf));
+    return result;
+}
+
+
+/** Read a model-specific register. */
+inline u64
+readMSR(u32 msr)
+{
+    u32 low, high;
+    asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+    return (u64(high) << 32) | low;
+}
+
+
+/** Write a model-specific register. */
+inline void
+writeMSR(u32 msr,
+         u64 value)
+{
+    asm volatile("wrmsr" : : "a"(u32(value)), "d"(u32(value >> 32)), "c"(msr) : "memory");
+}
+
+} /* namespace x86 */
+
+#endif /* __CPU_HH__ */
@@ -0,0 +1,125 @@
+/* Clock.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * TSC calibration and conversion.
+ */
+
+#include "Clock.hh"
+#include "PIT.hh"
+#include "kstd/SpinLock.hh"
+
+namespace {
+
+static kernel::Clock sClock;
+
+const u64 NanosecondsPerSecond = 1000000000;
+
+/** Calibration runs and how long each one lasts, in PIT input clocks (20 ms). */
+const u32 CalibrationRuns = 5;
+const u32 CalibrationCount = x86::PIT::BaseFrequency / 50;
+
+/** CPUID.80000007H:EDX bit saying the TSC is invariant. */
+const u32 CPUIDInvariantTSC = 1 << 8;
+
+bool
+cpuHasInvariantTSC()
+{
+    if (x86::cpuid(0x80000000).eax < 0x80000007) {
+        return false;
+    }
+    return (x86::cpuid(0x80000007).edx & CPUIDInvariantTSC) != 0;
+}
+
+} /* anonymous namespace */
+
+namespace kernel {
+
+/*
+ * Static
+ */
+
+Clock&
+Clock::systemClock()
+{
+    return sClock;
+}
+
+/*
+ * Public
+ */
+
+Clock::Clock()
+    : mConversion(),
+      mTSCFrequency(0),
+      mTSCInvariant(false)
+{ }
+
+
+void
+Clock::initialize()
+{
+    mTSCInvariant = cpuHasInvariantTSC();
+    mTSCFrequency = measureTSCFrequency();
+
+    // Pick the largest shift whose multiplier still fits in 32 bits. That's
+    // 32 for any TSC faster than 1 GHz.
+    Conversion conversion;
+    conversion.shift = 32;
+    for (;;) {
+        const u64 multiplier = (NanosecondsPerSecond << conversion.shift) / mTSCFrequency;
+        if (multiplier <= 0xFFFFFFFF || conversion.shift == 0) {
+            conversion.multiplier = u32(multiplier);
+            break;
+        }
+        conversion.shift--;
+    }
+    conversion.baseNanoseconds = 0;
+    conversion.baseTSC = x86::rdtsc();
+    mConversion.write(conversion);
+}
+
+/*
+ * Private
+ */
+
+u64
+Clock::toNanoseconds(const Conversion& conversion,
+                     u64 tsc)
+{
+    // Another CPU's TSC can be a hair behind the one that set the base.
+    const u64 delta = tsc > conversion.baseTSC ? tsc - conversion.baseTSC : 0;
+
+    // A 64 x 32 bit multiply, shifted right, done as two 32 x 32 bit
+    // multiplies so nothing overflows.
+    const u64 low = u64(u32(delta)) * conversion.multiplier;
+    const u64 high = (delta >> 32) * conversion.multiplier;
+    return conversion.baseNanoseconds + (low >> conversion.shift) + (high << (32 - conversion.shift));
+}
+
+
+u64
+Clock::measureTSCFrequency()
+{
+    auto& pit = x86::PIT::systemPIT();
+    kstd::InterruptGuard interrupts;
+
+    // Anything that gets in the way -- SMIs, a slow emulator -- only makes a
+    // run longer, so the shortest one is the most accurate.
+    u64 shortest = ~u64(0);
+    for (u32 run = 0; run < CalibrationRuns; run++) {
+        pit.startChannel2(CalibrationCount);
+        const u64 start = x86::rdtsc();
+        while (!pit.hasChannel2Expired()) { }
+        const u64 cycles = x86::rdtsc() - start;
+        if (cycles < shortest) {
+            shortest = cycles;
+        }
+    }
+    pit.stopChannel2();
+
+    return shortest * x86::PIT::BaseFrequency / CalibrationCount;
+}
+
+} /* namespace kernel */
@@ -0,0 +1,75 @@
+/* Clock.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * A high-resolution monotonic clock based on the time stamp counter.
+ */
+
+#ifndef __CLOCK_HH__
+#define __CLOCK_HH__
+
+#include "CPU.hh"
+#include "kstd/SeqLock.hh"
+#include "kstd/Types.hh"
+
+namespace kernel {
+
+/**
+ * The TSC's frequency is measured against PIT channel 2 at boot. Reading the
+ * clock is an rdtsc and a fixed-point multiply and shift -- no division --
+ * under a seqlock, so it's cheap enough to call anywhere.
+ *
+ * If the CPU doesn't advertise an invariant TSC, the TSC may change speed with
+ * power states and the clock will drift.
+ */
+struct Clock
+{
+    static Clock& systemClock();
+
+    Clock();
+
+    /** Calibrate the TSC. Takes about 100 ms. Interrupts are disabled while it runs. */
+    void initialize();
+
+    /** Nanoseconds since initialize(). */
+    u64
+    nowNanoseconds()
+        const
+    {
+        return toNanoseconds(mConversion.read(), x86::rdtsc());
+    }
+
+    /** Convert a TSC reading to nanoseconds since initialize(). */
+    u64 nanosecondsForTSC(u64 tsc) const { return toNanoseconds(mConversion.read(), tsc); }
+
+    /** Measured TSC frequency, in Hz. */
+    u64 tscFrequency() const { return mTSCFrequency; }
+
+    /** `true` if the TSC runs at a constant rate in every power state. */
+    bool isTSCInvariant() const { return mTSCInvariant; }
+
+private:
+    /**
+     * Parameters for converting a TSC reading to nanoseconds:
+     *   ns = baseNanoseconds + ((tsc - baseTSC) * multiplier) >> shift
+     */
+    struct Conversion
+    {
+        u64 baseTSC;
+        u64 baseNanoseconds;
+        u32 multiplier;
+        u32 shift;
+    };
+
+    kstd::SeqLocked<Conversion> mConversion;
+    u64 mTSCFrequency;
+    bool mTSCInvariant;
+
+    static u64 toNanoseconds(const Conversion& conversion, u64 tsc);
+    static u64 measureTSCFrequency();
+};
+
+} /* namespace kernel */
+
+#endif /* __CLOCK_HH__ */
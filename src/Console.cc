@@ -7,6 +7,7 @@
  */
 
 #include "Console.hh"
+#include "kstd/CString.hh"
 
 namespace kernel {
 
@@ -47,7 +48,8 @@ Console::systemConsole()
 Console::Console()
     : mBase(reinterpret_cast<uint16_t *>(0xB8000)),
       mCursor{0, 0},
-      mColor(makeVGAColor(Console::Color::LightGray, Console::Color::Black))
+      mColor(makeVGAColor(Console::Color::LightGray, Console::Color::Black)),
+      mLock()
 { }
 
 
@@ -73,14 +75,16 @@ Console::clear(Console::Color color)
 
 void
 Console::printChar(char c)
+{
+    write(&c, 1);
+}
+
+void
+Console::putChar(char c)
 {
     switch (c) {
         case '\n':
-            mCursor.col = 0;
-            if (++mCursor.row >= Console::Height) {
-                scroll();
-                mCursor.row = Console::Height - 1;
-            }
+            newline();
             break;
         case '\t':
             mCursor.col += 8;
@@ -95,11 +99,7 @@ Console::printChar(char c)
         default:
             putEntryAt(mCursor.col, mCursor.row, c, mColor);
             if (++mCursor.col == Console::Width) {
-                mCursor.col = 0;
-                if (++mCursor.row >= Console::Height) {
-                    scroll();
-                    mCursor.row = Console::Height - 1;
-                }
+                newline();
             }
             break;
     }
@@ -108,10 +108,35 @@ Console::printChar(char c)
 void
 Console::printString(const char *str)
 {
-    // XXX: THIS IS VERY UNSAFE. PUT DOWN THE POINTER ERYN. NO BAD ERYN DONT YOU DARE.
-    const char *cur = str;
-    while (*cur != '\0') {
-        printChar(*cur++);
+    write(str, kstd::CString::length(str));
+}
+
+void
+Console::write(const char *str,
+               size_t length)
+{
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+
+    const char *const end = str + length;
+    while (str < end) {
+        // Copy as much of the current line as we can in one go, stopping at a control character.
+        uint16_t *cell = mBase + mCursor.row * Console::Width + mCursor.col;
+        size_t room = Console::Width - mCursor.col;
+        if (room > size_t(end - str)) {
+            room = end - str;
+        }
+        size_t n = 0;
+        for (; n < room && str[n] != '\n' && str[n] != '\t'; n++) {
+            cell[n] = makeVGAEntry(str[n], mColor);
+        }
+        str += n;
+        mCursor.col += n;
+
+        if (mCursor.col == Console::Width) {
+            newline();
+        } else if (str < end && n < room) {
+            putChar(*str++);
+        }
     }
 }
 
@@ -136,6 +161,16 @@ Console::putEntryAt(size_t x,
     mBase[index] = makeVGAEntry(c, color);
 }
 
+void
+Console::newline()
+{
+    mCursor.col = 0;
+    if (++mCursor.row >= Console::Height) {
+        scroll();
+        mCursor.row = Console::Height - 1;
+    }
+}
+
 void
 Console::scroll(size_t lines)
 {
@@ -13,6 +13,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "Attributes.hh"
+#include "kstd/SpinLock.hh"
 
 
 namespace kernel {
@@ -61,6 +62,14 @@ struct Console
     /** Write a string to the terminal at the current cursor position. */
     void printString(const char *str);
 
+    /**
+     * Write `length` characters from `str` to the terminal at the current
+     * cursor position. Runs of printable characters are copied straight into
+     * the frame buffer; cursor wrapping and scrolling are only checked at the
+     * end of each line. Safe to call from interrupt handlers and other CPUs.
+     */
+    void write(const char *str, size_t length);
+
     /**
      * Set the current cursor color. Subsequent characters will be written in
      * this color.
@@ -71,11 +80,15 @@ private:
     uint16_t *const mBase;
     Cursor mCursor;
     uint8_t mColor;
+    /** Serializes writes. */
+    kstd::SpinLock mLock;
 
     Console(const Console& other) = delete;
     Console& operator=(const Console& other) = delete;
 
+    void putChar(char c);
     void putEntryAt(size_t x, size_t y, char c, uint8_t color);
+    void newline();
     void scroll(size_t lines = 1);
 };
 
@@ -0,0 +1,135 @@
+/* CrossCall.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Running a function on other CPUs.
+ */
+
+#include "CrossCall.hh"
+#include "APIC.hh"
+#include "Interrupts.hh"
+#include "SMP.hh"
+#include "kstd/SpinLock.hh"
+
+namespace {
+
+static kernel::CrossCall sCrossCall;
+
+} /* anonymous namespace */
+
+namespace kernel {
+
+/*
+ * Static
+ */
+
+CrossCall&
+CrossCall::systemCrossCall()
+{
+    return sCrossCall;
+}
+
+/*
+ * Public
+ */
+
+CrossCall::CrossCall()
+    : mQueues(),
+      mInterruptsSent(),
+      mIsUsingAPIC(false)
+{ }
+
+
+void
+CrossCall::initialize()
+{
+    auto& interruptHandler = x86::InterruptHandler::systemInterruptHandler();
+    if (!interruptHandler.isUsingAPIC()) {
+        // One CPU, so nobody to call.
+        return;
+    }
+    interruptHandler.registerHandler(Vector, callInterrupt, this);
+    mIsUsingAPIC = true;
+}
+
+
+void
+CrossCall::call(u32 cpus,
+                Function function,
+                void* argument)
+{
+    // Staying on this CPU, and out of the way of our own IPI handler, which
+    // shares our queue.
+    kstd::InterruptGuard interrupts;
+    const usize here = x86::currentCPU();
+    const u32 self = 1u << here;
+    const u32 online = SMP::systemSMP().onlineCPUs();
+    const u32 others = mIsUsingAPIC ? cpus & online & ~self : 0;
+
+    Request request;
+    request.function = function;
+    request.argument = argument;
+    request.remaining.store(others, kstd::MemoryOrder::Relaxed);
+
+    for (u32 remaining = others; remaining != 0; remaining &= remaining - 1) {
+        const usize cpu = x86::bitScanForward(remaining);
+        while (!mQueues[cpu].push(&request)) {
+            // Full. It's probably waiting on us to run something.
+            runQueued();
+        }
+    }
+
+    if (others != 0) {
+        const auto& localAPIC = x86::InterruptHandler::systemInterruptHandler().localAPIC();
+        if (others == (online & ~self)) {
+            localAPIC.sendInterprocessorInterrupt(x86::LocalAPIC::Shorthand::AllButSelf, x86::LocalAPIC::DeliveryMode::Fixed, Vector);
+            mInterruptsSent[here]++;
+        } else {
+            auto& smp = SMP::systemSMP();
+            for (u32 remaining = others; remaining != 0; remaining &= remaining - 1) {
+                const usize cpu = x86::bitScanForward(remaining);
+                localAPIC.sendInterprocessorInterrupt(smp.apicID(cpu), x86::LocalAPIC::DeliveryMode::Fixed, Vector);
+                mInterruptsSent[here]++;
+            }
+        }
+    }
+
+    if (cpus & self) {
+        function(argument);
+    }
+
+    while (request.remaining.load(kstd::MemoryOrder::Acquire) != 0) {
+        runQueued();
+        x86::pause();
+    }
+}
+
+/*
+ * Private
+ */
+
+void
+CrossCall::runQueued()
+{
+    const usize here = x86::currentCPU();
+    Queue& queue = mQueues[here];
+    Request* request;
+    while (queue.pop(request)) {
+        request->function(request->argument);
+        // The caller's waiting on this, with the request on its stack. Don't
+        // touch it after.
+        request->remaining.fetchAnd(~(1u << here), kstd::MemoryOrder::Release);
+    }
+}
+
+
+bool
+CrossCall::callInterrupt(const x86::InterruptFrame&,
+                         void* context)
+{
+    static_cast<CrossCall*>(context)->runQueued();
+    return true;
+}
+
+} /* namespace kernel */
@@ -0,0 +1,87 @@
+/* CrossCall.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Running a function on other CPUs.
+ *
+ * Each CPU has a lock-free queue of requests. A caller pushes a request onto
+ * the queue of every CPU it wants, sends each of them an IPI, and waits for
+ * them all to finish with it. The IPI handler runs everything on its CPU's
+ * queue, so a CPU that gets several requests before it gets to the interrupt
+ * runs them all on one.
+ *
+ * Functions run in interrupt context on the target CPU, with interrupts
+ * disabled. They mustn't block, or take a lock the caller holds.
+ */
+
+#ifndef __CROSSCALL_HH__
+#define __CROSSCALL_HH__
+
+#include "CPU.hh"
+#include "kstd/Atomic.hh"
+#include "kstd/RingBuffer.hh"
+#include "kstd/Types.hh"
+
+namespace x86 {
+struct InterruptFrame;
+}
+
+namespace kernel {
+
+struct CrossCall
+{
+    typedef void (*Function)(void* argument);
+
+    /** Local APIC vector for call IPIs. */
+    static const u8 Vector = 0xED;
+
+    /** Requests each CPU's queue holds. Callers wait for room if it's full. */
+    static const usize QueueSize = 16;
+
+    static CrossCall& systemCrossCall();
+
+    CrossCall();
+
+    /** Register the IPI handler. Call on the boot CPU, after interrupts are set up. */
+    void initialize();
+
+    /**
+     * Run `function(argument)` on every CPU in `cpus`, a bit mask of CPU
+     * numbers, and wait for them all to return. If this CPU is in the set, it
+     * runs the function too, directly. CPUs that aren't online are skipped.
+     *
+     * Interrupts are disabled for the duration. Requests sent to this CPU in
+     * the meantime are run while it waits, so two CPUs calling each other at
+     * once don't deadlock.
+     */
+    void call(u32 cpus, Function function, void* argument);
+
+    /** Number of call IPIs this CPU has sent. */
+    u32 interruptsSent(usize cpu) const { return mInterruptsSent[cpu]; }
+
+private:
+    struct Request
+    {
+        Function function;
+        void* argument;
+        /** CPUs that haven't finished with it yet. */
+        kstd::Atomic<u32> remaining;
+    };
+
+    typedef kstd::MultiProducerRingBuffer<Request*, QueueSize> Queue;
+
+    /** One queue per CPU. Only its own CPU pops from it, with interrupts disabled. */
+    Queue mQueues[x86::MaxCPUs];
+    u32 mInterruptsSent[x86::MaxCPUs];
+    bool mIsUsingAPIC;
+
+    /** Run every request queued for this CPU. */
+    void runQueued();
+
+    static bool callInterrupt(const x86::InterruptFrame& frame, void* context);
+};
+
+} /* namespace kernel */
+
+#endif /* __CROSSCALL_HH__ */
@@ -0,0 +1,80 @@
+/* DeferredWork.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Deferred interrupt work.
+ */
+
+#include "DeferredWork.hh"
+#include "kstd/SpinLock.hh"
+
+namespace {
+
+static kernel::DeferredWork sDeferredWork;
+
+} /* anonymous namespace */
+
+namespace kernel {
+
+/*
+ * Static
+ */
+
+DeferredWork&
+DeferredWork::systemDeferredWork()
+{
+    return sDeferredWork;
+}
+
+/*
+ * Public
+ */
+
+DeferredWork::DeferredWork()
+    : mQueues()
+{ }
+
+
+bool
+DeferredWork::schedule(WorkItem& item)
+{
+    if (item.pending.exchange(true, kstd::MemoryOrder::Acquire)) {
+        return false;
+    }
+    kstd::InterruptGuard interrupts;
+    mQueues[x86::currentCPU()].items.pushBack(item);
+    return true;
+}
+
+
+bool
+DeferredWork::run()
+{
+    const u32 flags = x86::saveFlagsAndDisableInterrupts();
+    Queue& queue = mQueues[x86::currentCPU()];
+    if (queue.isRunning) {
+        x86::restoreFlags(flags);
+        return !queue.items.isEmpty();
+    }
+
+    queue.isRunning = true;
+    for (u32 i = 0; i < Budget; i++) {
+        WorkItem* item = queue.items.popFront();
+        if (!item) {
+            break;
+        }
+        // Clear pending first so the item can reschedule itself.
+        item->pending.store(false, kstd::MemoryOrder::Release);
+        x86::enableInterrupts();
+        item->function(*item);
+        x86::disableInterrupts();
+    }
+    queue.isRunning = false;
+
+    const bool morePending = !queue.items.isEmpty();
+    x86::restoreFlags(flags);
+    return morePending;
+}
+
+} /* namespace kernel */
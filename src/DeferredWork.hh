@@ -0,0 +1,87 @@
+/* DeferredWork.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Deferred interrupt work. Interrupt handlers should do the least they can
+ * -- acknowledge the device, grab its data -- and schedule a WorkItem for
+ * everything else. Work runs on the same CPU after the interrupt has been
+ * acknowledged, with interrupts enabled, before returning to whatever was
+ * interrupted.
+ */
+
+#ifndef __DEFERREDWORK_HH__
+#define __DEFERREDWORK_HH__
+
+#include "CPU.hh"
+#include "kstd/Atomic.hh"
+#include "kstd/List.hh"
+#include "kstd/Types.hh"
+
+namespace kernel {
+
+/** A unit of deferred work. A pending item is only queued once. */
+struct WorkItem
+{
+    typedef void (*Function)(WorkItem& item);
+
+    explicit
+    WorkItem(Function function)
+        : node(),
+          pending(false),
+          function(function)
+    { }
+
+    bool isPending() const { return pending.load(kstd::MemoryOrder::Relaxed); }
+
+    kstd::ListNode node;
+    kstd::Atomic<bool> pending;
+    Function function;
+};
+
+
+struct DeferredWork
+{
+    /** Most work items to run per drain, so one busy source can't starve the rest. */
+    static const u32 Budget = 16;
+
+    static DeferredWork& systemDeferredWork();
+
+    DeferredWork();
+
+    /**
+     * Queue `item` on this CPU. Safe to call from interrupt handlers.
+     * @return `false` if the item was already pending.
+     */
+    bool schedule(WorkItem& item);
+
+    /**
+     * Run up to Budget pending items on this CPU. Interrupts are enabled while
+     * each item runs and restored on return. Does nothing if this CPU is
+     * already running work further up the stack.
+     *
+     * @return `true` if work is still pending.
+     */
+    bool run();
+
+    /** `true` if this CPU has work queued. */
+    bool hasPendingWork() const { return !mQueues[x86::currentCPU()].items.isEmpty(); }
+
+    /** `true` if this CPU is in the middle of run(). */
+    bool isRunning() const { return mQueues[x86::currentCPU()].isRunning; }
+
+private:
+    struct Queue
+    {
+        kstd::List<WorkItem, &WorkItem::node> items;
+        /** Set while run() is draining this queue. */
+        bool isRunning;
+    };
+
+    /** One queue per CPU. Only touched by its own CPU, with interrupts disabled. */
+    Queue mQueues[x86::MaxCPUs];
+};
+
+} /* namespace kernel */
+
+#endif /* __DEFERREDWORK_HH__ */
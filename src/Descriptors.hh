@@ -12,6 +12,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "CPU.hh"
 
 
 namespace x86 {
@@ -96,9 +97,17 @@ struct GDT
     /** Load this GDT into the CPU and flush the registers. */
     void load() const;
 
+    /**
+     * Index of CPU 0's per-CPU data segment. Each CPU has one, in order, based
+     * at its copy of the per-CPU data. See PerCPU.hh.
+     */
+    static const size_t PerCPUIndex = 3;
+
+    /** Selector for `cpu`'s per-CPU data segment. */
+    static uint16_t perCPUSelector(size_t cpu) { return uint16_t((PerCPUIndex + cpu) * sizeof(Descriptor)); }
+
 private:
-    // TODO: Maybe eventually I can make this variable? Maybe use templates?
-    static const size_t Size = 5;
+    static const size_t Size = PerCPUIndex + MaxCPUs;
 
     Descriptor mTable[Size];
 };
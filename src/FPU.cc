@@ -0,0 +1,258 @@
+/* FPU.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Lazy FPU and SSE state switching.
+ */
+
+#include "FPU.hh"
+#include "CPU.hh"
+#include "Interrupts.hh"
+#include "Scheduler.hh"
+#include "Thread.hh"
+
+namespace {
+
+static kernel::FPU sFPU;
+
+/** CR0 bits. */
+const u32 CR0MonitorCoprocessor = 1 << 1;
+const u32 CR0Emulation = 1 << 2;
+const u32 CR0TaskSwitched = 1 << 3;
+const u32 CR0NumericError = 1 << 5;
+
+/** CR4 bits: the OS saves SSE state with FXSAVE, and handles #XM. */
+const u32 CR4OSFXSR = 1 << 9;
+const u32 CR4OSXMMEXCPT = 1 << 10;
+
+/** CPUID.1:EDX bits. */
+const u32 CPUIDFXSRFeature = 1 << 24;
+const u32 CPUIDSSEFeature = 1 << 25;
+
+/** MXCSR after reset: every SIMD exception masked, round to nearest. */
+const u32 DefaultMXCSR = 0x1F80;
+
+
+inline void
+fxsave(kernel::FPUState& state)
+{
+    asm volatile("fxsave %0" : "=m"(state));
+}
+
+
+inline void
+fxrstor(const kernel::FPUState& state)
+{
+    asm volatile("fxrstor %0" : : "m"(state));
+}
+
+
+inline void
+setTaskSwitched()
+{
+    x86::writeCR0(x86::readCR0() | CR0TaskSwitched);
+}
+
+
+/** Put the registers in their reset state. */
+void
+resetRegisters(bool hasSSE)
+{
+    asm volatile("fninit");
+    if (hasSSE) {
+        const u32 mxcsr = DefaultMXCSR;
+        asm volatile("ldmxcsr %0" : : "m"(mxcsr));
+    }
+}
+
+} /* anonymous namespace */
+
+namespace kernel {
+
+PER_CPU x86::PerCPU<Thread*> FPU::sOwner;
+
+/*
+ * Static
+ */
+
+FPU&
+FPU::systemFPU()
+{
+    return sFPU;
+}
+
+/*
+ * Public
+ */
+
+FPU::FPU()
+    : mIsAvailable(false),
+      mHasSSE(false)
+{ }
+
+
+void
+FPU::initialize()
+{
+    const u32 features = x86::cpuid(1).edx;
+    mIsAvailable = (features & CPUIDFXSRFeature) != 0;
+    mHasSSE = mIsAvailable && (features & CPUIDSSEFeature) != 0;
+    if (mIsAvailable) {
+        x86::InterruptHandler::systemInterruptHandler().registerHandler(u8(x86::Interrupt::NM), deviceNotAvailable, this);
+    }
+    initializeCPU();
+}
+
+
+void
+FPU::initializeCPU()
+{
+    u32 cr0 = x86::readCR0();
+    if (!mIsAvailable) {
+        x86::writeCR0(cr0 | CR0Emulation);
+        return;
+    }
+
+    // x87 errors as #MF rather than through the 8259s, and TS traps WAIT too.
+    cr0 = (cr0 & ~(CR0Emulation | CR0TaskSwitched)) | CR0MonitorCoprocessor | CR0NumericError;
+    x86::writeCR0(cr0);
+    u32 cr4 = x86::readCR4() | CR4OSFXSR;
+    if (mHasSSE) {
+        cr4 |= CR4OSXMMEXCPT;
+    }
+    x86::writeCR4(cr4);
+    resetRegisters(mHasSSE);
+
+    sOwner.store(nullptr);
+    x86::writeCR0(cr0 | CR0TaskSwitched);
+}
+
+
+void
+FPU::setEager(Thread& thread,
+              bool eager)
+{
+    thread.mIsFPUEager = eager;
+}
+
+
+void
+FPU::switchThreads(Thread& previous,
+                   Thread& next)
+{
+    if (!mIsAvailable) {
+        return;
+    }
+
+    // TS is only clear while the running thread's state is in the registers,
+    // which means it used them since it was switched to.
+    const u32 cr0 = x86::readCR0();
+    const bool isLive = (cr0 & CR0TaskSwitched) == 0;
+    if (isLive) {
+        if (previous.mState == Thread::State::Exiting) {
+            sOwner.store(nullptr);
+        } else {
+            fxsave(previous.mFPUState);
+        }
+    }
+
+    if (next.mIsFPUEager) {
+        x86::clearTaskSwitched();
+        if (!isLoaded(next)) {
+            load(next);
+        }
+    } else if (isLive) {
+        // Even if the registers still hold next's state, leave TS set.
+        // deviceNotAvailable() clears it without a reload if next uses them,
+        // and if it doesn't, there's nothing to save when it's switched out.
+        x86::writeCR0(cr0 | CR0TaskSwitched);
+    }
+}
+
+/*
+ * Private
+ */
+
+void
+FPU::load(Thread& thread)
+{
+    if (thread.mHasFPUState) {
+        fxrstor(thread.mFPUState);
+    } else {
+        resetRegisters(mHasSSE);
+        thread.mHasFPUState = true;
+    }
+    thread.mFPUCPU = x86::currentCPU();
+    sOwner.store(&thread);
+}
+
+
+bool
+FPU::isLoaded(const Thread& thread)
+    const
+{
+    return sOwner.load() == &thread && thread.mFPUCPU == x86::currentCPU();
+}
+
+
+void
+FPU::beginKernelUse()
+{
+    if (!mIsAvailable) {
+        return;
+    }
+    if (x86::readCR0() & CR0TaskSwitched) {
+        x86::clearTaskSwitched();
+    } else if (Thread* owner = sOwner.load()) {
+        fxsave(owner->mFPUState);
+    }
+    resetRegisters(mHasSSE);
+    // The registers are ours now. Whoever had them reloads on next use.
+    sOwner.store(nullptr);
+}
+
+
+void
+FPU::endKernelUse()
+{
+    if (mIsAvailable) {
+        setTaskSwitched();
+    }
+}
+
+
+bool
+FPU::deviceNotAvailable(const x86::InterruptFrame&,
+                        void* context)
+{
+    auto self = static_cast<FPU*>(context);
+    Thread* thread = Scheduler::systemScheduler().current();
+    if (!thread) {
+        return false;
+    }
+    x86::clearTaskSwitched();
+    if (!self->isLoaded(*thread)) {
+        self->load(*thread);
+    }
+    return true;
+}
+
+/*
+ * FPUGuard
+ */
+
+FPUGuard::FPUGuard()
+    : mFlags(x86::saveFlagsAndDisableInterrupts())
+{
+    FPU::systemFPU().beginKernelUse();
+}
+
+
+FPUGuard::~FPUGuard()
+{
+    FPU::systemFPU().endKernelUse();
+    x86::restoreFlags(mFlags);
+}
+
+} /* namespace kernel */
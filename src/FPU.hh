@@ -0,0 +1,117 @@
+/* FPU.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * x87 FPU and SSE state, switched lazily between threads.
+ *
+ * Each thread has a 512 byte FXSAVE area for its FPU and SSE registers. Most
+ * threads never touch them, so switching to a thread doesn't load them.
+ * Instead CR0.TS is set, and the thread's first FPU or SSE instruction raises
+ * #NM, whose handler loads the thread's state, clears TS, and returns to the
+ * instruction. A thread's state is saved when it's switched out, but only if
+ * it was loaded during that run. Threads that don't use the FPU cost nothing.
+ *
+ * Each CPU remembers whose state is in its registers. A thread that comes
+ * back to a CPU nobody else has used the FPU on in the meantime, and that
+ * hasn't used it anywhere else either, gets TS cleared without a reload.
+ *
+ * Threads that always use SIMD can ask to be eager, and have their state
+ * loaded as soon as they're switched to, rather than take a trap on every run.
+ *
+ * Kernel code that wants the FPU or SSE registers has to hold an FPUGuard.
+ */
+
+#ifndef __FPU_HH__
+#define __FPU_HH__
+
+#include "PerCPU.hh"
+#include "kstd/Types.hh"
+
+namespace x86 {
+struct InterruptFrame;
+}
+
+namespace kernel {
+
+struct Thread;
+
+/** What FXSAVE stores and FXRSTOR loads. */
+struct alignas(16) FPUState
+{
+    u8 bytes[512];
+};
+
+
+struct FPU
+{
+    static FPU& systemFPU();
+
+    FPU();
+
+    /**
+     * Check for FXSAVE, register the #NM handler, and set up the boot CPU.
+     * Call after the interrupt handler is initialized. Without FXSAVE, FPU
+     * and SSE instructions are left disabled, and trap.
+     */
+    void initialize();
+
+    /** Set up this CPU. Application processors call this as they start. */
+    void initializeCPU();
+
+    bool isAvailable() const { return mIsAvailable; }
+
+    /** Load `thread`'s state as soon as it's switched to, instead of on first use. */
+    void setEager(Thread& thread, bool eager);
+
+    /**
+     * Called by the scheduler on the way from `previous` to `next`, with
+     * interrupts disabled. Saves `previous`'s state if it's live, and sets up
+     * `next`'s.
+     */
+    void switchThreads(Thread& previous, Thread& next);
+
+private:
+    friend struct FPUGuard;
+
+    /** Thread whose state is in this CPU's registers, if any. */
+    static x86::PerCPU<Thread*> sOwner;
+
+    bool mIsAvailable;
+    bool mHasSSE;
+
+    /** Load `thread`'s state into this CPU's registers, or a clean state if it has none yet. */
+    void load(Thread& thread);
+
+    /** `true` if this CPU's registers still hold `thread`'s latest state. */
+    bool isLoaded(const Thread& thread) const;
+
+    /** @{ Taking the registers for the kernel, and giving them back. See FPUGuard. */
+    void beginKernelUse();
+    void endKernelUse();
+    /** @} */
+
+    static bool deviceNotAvailable(const x86::InterruptFrame& frame, void* context);
+};
+
+
+/**
+ * Lets kernel code use the FPU and SSE registers. The running thread's state
+ * is saved first, and reloaded when it next uses them. Interrupts are disabled
+ * while it's held, and it can't be nested.
+ */
+struct FPUGuard
+{
+    FPUGuard();
+    ~FPUGuard();
+
+private:
+    u32 mFlags;
+
+    FPUGuard(const FPUGuard& other) = delete;
+    FPUGuard& operator=(const FPUGuard& other) = delete;
+};
+
+} /* namespace kernel */
+
+#endif /* __FPU_HH__ */
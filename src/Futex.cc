@@ -0,0 +1,94 @@
+/* Futex.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Address-keyed waiting.
+ */
+
+#include "Futex.hh"
+#include "CPU.hh"
+#include "Scheduler.hh"
+#include "Thread.hh"
+
+namespace {
+
+static kernel::Futex sFutex;
+
+} /* anonymous namespace */
+
+namespace kernel {
+
+/*
+ * Static
+ */
+
+Futex&
+Futex::systemFutex()
+{
+    return sFutex;
+}
+
+/*
+ * Public
+ */
+
+Futex::Futex()
+    : mLock(),
+      mWaiters()
+{ }
+
+
+bool
+Futex::wait(const u32* address,
+            u32 expected)
+{
+    auto& scheduler = Scheduler::systemScheduler();
+    Waiter waiter;
+    waiter.address = uptr(address);
+    waiter.thread = scheduler.current();
+
+    const u32 flags = x86::saveFlagsAndDisableInterrupts();
+    mLock.lock();
+    if (__atomic_load_n(address, __ATOMIC_SEQ_CST) != expected) {
+        mLock.unlock();
+        x86::restoreFlags(flags);
+        return false;
+    }
+    mWaiters.insert(waiter);
+    scheduler.block(mLock);
+
+    // wake() takes us out of the table. If something else woke us, the
+    // waiter has to come out before it goes off the stack.
+    mLock.lock();
+    if (waiter.link.isLinked()) {
+        mWaiters.remove(waiter);
+    }
+    mLock.unlock();
+    x86::restoreFlags(flags);
+    return true;
+}
+
+
+usize
+Futex::wake(const u32* address,
+            usize count)
+{
+    auto& scheduler = Scheduler::systemScheduler();
+    const uptr key = uptr(address);
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    usize woken = 0;
+    Waiter* waiter = mWaiters.find(key);
+    while (waiter && woken < count) {
+        Waiter* next = mWaiters.find(key, waiter);
+        // The waiter's gone as soon as its thread runs.
+        Thread* thread = waiter->thread;
+        mWaiters.remove(*waiter);
+        scheduler.wake(*thread);
+        woken++;
+        waiter = next;
+    }
+    return woken;
+}
+
+} /* namespace kernel */
@@ -0,0 +1,87 @@
+/* Futex.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Waiting on the value of a word of memory, by its address.
+ *
+ * Whoever owns the word does the fast path with atomics on it, and only comes
+ * here to sleep or to wake sleepers. Nothing but the address is needed to
+ * wait, so a word can be waited on without allocating a WaitQueue for it,
+ * which is what user space will need for its own locks. Waiters live in a hash
+ * table keyed by address; each one is on the waiting thread's stack.
+ *
+ *     // Waiter: sleep while the word is 0.
+ *     while (__atomic_load_n(&word, __ATOMIC_SEQ_CST) == 0) {
+ *         futex.wait(&word, 0);
+ *     }
+ *
+ *     // Waker
+ *     __atomic_store_n(&word, 1, __ATOMIC_SEQ_CST);
+ *     futex.wake(&word, Futex::WakeAll);
+ */
+
+#ifndef __FUTEX_HH__
+#define __FUTEX_HH__
+
+#include "kstd/HashTable.hh"
+#include "kstd/List.hh"
+#include "kstd/SpinLock.hh"
+#include "kstd/Types.hh"
+
+namespace kernel {
+
+struct Thread;
+
+struct Futex
+{
+    /** Count for wake() to wake everyone. */
+    static const usize WakeAll = ~usize(0);
+
+    static Futex& systemFutex();
+
+    Futex();
+
+    /**
+     * If the word at `address` holds `expected`, sleep until someone wake()s
+     * that address. Checking the word and going to sleep are atomic with
+     * respect to wake(), so a waker that changes the word first can't be
+     * missed.
+     *
+     * @return `false` right away if the word didn't hold `expected`, or
+     *      `true` once woken.
+     */
+    bool wait(const u32* address, u32 expected);
+
+    /**
+     * Wake up to `count` threads waiting on `address`, longest waiting first.
+     * Safe to call from interrupt handlers.
+     *
+     * @return Number of threads woken.
+     */
+    usize wake(const u32* address, usize count = 1);
+
+private:
+    struct Waiter
+    {
+        uptr address;
+        Thread* thread;
+        kstd::ListNode link;
+    };
+
+    struct WaiterTraits
+    {
+        typedef uptr Key;
+        static Key key(const Waiter& waiter) { return waiter.address; }
+    };
+
+    kstd::SpinLock mLock;
+    kstd::HashTable<Waiter, &Waiter::link, WaiterTraits, 6> mWaiters;
+
+    Futex(const Futex& other) = delete;
+    Futex& operator=(const Futex& other) = delete;
+};
+
+} /* namespace kernel */
+
+#endif /* __FUTEX_HH__ */
@@ -0,0 +1,141 @@
+/* InterruptStatistics.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Per-vector interrupt latency and rate statistics.
+ */
+
+#ifdef CONFIG_INTERRUPT_STATISTICS
+
+#include "InterruptStatistics.hh"
+#include "kstd/Format.hh"
+#include "kstd/Memory.hh"
+
+namespace {
+
+/** Index of the histogram bucket for `cycles`: floor(log2(cycles)), clamped. */
+inline usize
+bucketForCycles(u64 cycles)
+{
+    const u32 clamped = cycles > 0xFFFFFFFF ? 0xFFFFFFFF : u32(cycles);
+    const usize bucket = clamped ? 31 - __builtin_clz(clamped) : 0;
+    return bucket < x86::InterruptStatistics::HistogramBuckets
+         ? bucket
+         : x86::InterruptStatistics::HistogramBuckets - 1;
+}
+
+} /* anonymous namespace */
+
+namespace x86 {
+
+/*
+ * Public
+ */
+
+InterruptStatistics::InterruptStatistics()
+    : mStormThreshold(DefaultStormThreshold),
+      mStormWindow(DefaultStormWindow),
+      mStorms()
+{
+    reset();
+}
+
+
+bool
+InterruptStatistics::record(u8 vector,
+                            u64 start,
+                            u64 end)
+{
+    Vector& stats = mCPUs[currentCPU()].vectors[vector];
+    const u64 cycles = end - start;
+    const u32 clamped = cycles > 0xFFFFFFFF ? 0xFFFFFFFF : u32(cycles);
+
+    stats.count++;
+    stats.totalCycles += cycles;
+    if (clamped < stats.minimumCycles) {
+        stats.minimumCycles = clamped;
+    }
+    if (clamped > stats.maximumCycles) {
+        stats.maximumCycles = clamped;
+    }
+    stats.histogram[bucketForCycles(cycles)]++;
+
+    if (start - stats.windowStart > mStormWindow) {
+        stats.windowStart = start;
+        stats.windowCount = 0;
+    }
+    // Flag the storm once per window, when the threshold is crossed.
+    if (++stats.windowCount == mStormThreshold + 1) {
+        stats.storms++;
+        mStorms.push(vector);
+        return true;
+    }
+    return false;
+}
+
+
+void
+InterruptStatistics::setStormThreshold(u32 threshold,
+                                       u64 windowCycles)
+{
+    mStormThreshold = threshold;
+    mStormWindow = windowCycles;
+}
+
+
+void
+InterruptStatistics::dump()
+    const
+{
+    for (usize cpu = 0; cpu < MaxCPUs; cpu++) {
+        for (usize v = 0; v < IDT::Size; v++) {
+            const Vector& stats = mCPUs[cpu].vectors[v];
+            if (stats.count == 0) {
+                continue;
+            }
+            kstd::print("cpu{} vector 0x{:02X}: count {}, cycles min {} avg {} max {}, storms {}\n",
+                        cpu, v, stats.count, stats.minimumCycles, stats.averageCycles(),
+                        stats.maximumCycles, stats.storms);
+
+            // The histogram, as "2^bucket:count" for non-empty buckets.
+            char line[kstd::PrintFormatBufferSize];
+            line[0] = '\0';
+            usize length = 0;
+            for (usize b = 0; b < HistogramBuckets && length < sizeof(line) - 1; b++) {
+                if (stats.histogram[b]) {
+                    length += kstd::format(line + length, sizeof(line) - length, " 2^{}:{}", b, stats.histogram[b]);
+                }
+            }
+            kstd::print("   {}\n", line);
+        }
+    }
+}
+
+
+void
+InterruptStatistics::reportStorms()
+{
+    u8 vector;
+    while (mStorms.pop(vector)) {
+        kstd::print("Interrupt storm on vector 0x{:02X}: more than {} interrupts in {} cycles\n",
+                    vector, mStormThreshold, mStormWindow);
+    }
+}
+
+
+void
+InterruptStatistics::reset()
+{
+    for (usize cpu = 0; cpu < MaxCPUs; cpu++) {
+        for (usize v = 0; v < IDT::Size; v++) {
+            Vector& stats = mCPUs[cpu].vectors[v];
+            kstd::Memory::zero(&stats, sizeof(stats));
+            stats.minimumCycles = 0xFFFFFFFF;
+        }
+    }
+}
+
+} /* namespace x86 */
+
+#endif /* CONFIG_INTERRUPT_STATISTICS */
@@ -0,0 +1,102 @@
+/* InterruptStatistics.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Per-vector interrupt latency and rate statistics. The dispatcher timestamps
+ * each interrupt with rdtsc on the way in and out of its handlers and records
+ * the difference here: a count, min/avg/max, and a log2 histogram of handler
+ * cycles, kept separately for each CPU so recording never shares a cache line.
+ *
+ * A storm detector flags any vector that fires more than a configurable number
+ * of times within a window of cycles.
+ *
+ * Only built with CONFIG_INTERRUPT_STATISTICS.
+ */
+
+#ifndef __INTERRUPTSTATISTICS_HH__
+#define __INTERRUPTSTATISTICS_HH__
+
+#ifdef CONFIG_INTERRUPT_STATISTICS
+
+#include "CPU.hh"
+#include "Descriptors.hh"
+#include "kstd/RingBuffer.hh"
+#include "kstd/Types.hh"
+
+namespace x86 {
+
+struct InterruptStatistics
+{
+    /**
+     * Histogram buckets. Bucket i counts handlers that took [2^i, 2^(i+1))
+     * cycles; the last bucket counts everything longer.
+     */
+    static const usize HistogramBuckets = 24;
+
+    /** Storm detector defaults: this many interrupts within this many cycles. */
+    static const u32 DefaultStormThreshold = 10000;
+    static const u64 DefaultStormWindow = u64(1) << 30;
+
+    struct Vector
+    {
+        u32 count;
+        u32 minimumCycles;
+        u32 maximumCycles;
+        u64 totalCycles;
+        u32 histogram[HistogramBuckets];
+
+        /** Start of the current storm detection window, in TSC cycles. */
+        u64 windowStart;
+        /** Interrupts seen in the current window. */
+        u32 windowCount;
+        /** Number of windows in which this vector stormed. */
+        u32 storms;
+
+        u32 averageCycles() const { return count ? u32(totalCycles / count) : 0; }
+    };
+
+    InterruptStatistics();
+
+    /**
+     * Record one interrupt on `vector` whose handlers ran from `start` to
+     * `end`, in TSC cycles. Called by the dispatcher with interrupts disabled.
+     *
+     * @return `true` if this interrupt tipped the vector into a storm.
+     */
+    bool record(u8 vector, u64 start, u64 end);
+
+    /** Statistics for `vector` on `cpu`. */
+    const Vector& vector(usize cpu, u8 vector) const { return mCPUs[cpu].vectors[vector]; }
+
+    /** Flag vectors that fire more than `threshold` times in `windowCycles`. */
+    void setStormThreshold(u32 threshold, u64 windowCycles);
+
+    /** Print every vector that has fired, on every CPU. */
+    void dump() const;
+
+    /** Print a line for each storm flagged since the last call. */
+    void reportStorms();
+
+    /** Zero every counter. */
+    void reset();
+
+private:
+    struct alignas(kstd::CacheLineSize) PerCPU
+    {
+        Vector vectors[IDT::Size];
+    };
+
+    PerCPU mCPUs[MaxCPUs];
+    u32 mStormThreshold;
+    u64 mStormWindow;
+
+    /** Vectors that stormed, waiting to be reported. Pushed from interrupt context. */
+    kstd::MultiProducerRingBuffer<u8, 16> mStorms;
+};
+
+} /* namespace x86 */
+
+#endif /* CONFIG_INTERRUPT_STATISTICS */
+
+#endif /* __INTERRUPTSTATISTICS_HH__ */
@@ -7,21 +7,20 @@
  */
 
 #include "Interrupts.hh"
+#include "CPU.hh"
 #include "Console.hh"
+#include "DeferredWork.hh"
 #include "IO.hh"
 #include "Kernel.hh"
+#include "Scheduler.hh"
+#include "kstd/Format.hh"
 #include "kstd/PrintFormat.hh"
+#include "kstd/RingBuffer.hh"
 
 
 extern "C" {
-    // Assembly functions. See isr.S.
-    void unhandledInterrupt();
-    void handleDEException();
-    void handleNMIInterrupt();
-    void handleDFException();
-    void handleGPException();
-    void handleHardwareInterrupt0();
-    void handleHardwareInterrupt1();
+    // Interrupt stub addresses, by vector. See isr.S.
+    extern void (*const isrStubTable[])();
 }
 
 namespace  {
@@ -42,6 +41,7 @@ static const char* sExceptionIdentifiers[] = {
     "#SS",
     "#GP",
     "#PF",
+    "Int15",
     "#MF",
     "#AC",
     "#MC",
@@ -49,6 +49,114 @@ static const char* sExceptionIdentifiers[] = {
     "#VE",
 };
 
+#ifdef CONFIG_INTERRUPT_STATISTICS
+void
+reportInterruptStorms(kernel::WorkItem&)
+{
+    x86::InterruptHandler::systemInterruptHandler().statistics().reportStorms();
+}
+
+static kernel::WorkItem sStormWork(reportInterruptStorms);
+
+/** F12 make code. Dumps interrupt statistics. */
+const u8 StatisticsScancode = 0x58;
+#endif
+
+/** Scancodes read by the keyboard interrupt, waiting to be processed. */
+static kstd::RingBuffer<u8, 64> sScancodes;
+
+void
+printScancodes(kernel::WorkItem&)
+{
+    u8 scancode;
+    while (sScancodes.pop(scancode)) {
+#ifdef CONFIG_INTERRUPT_STATISTICS
+        if (scancode == StatisticsScancode) {
+            x86::InterruptHandler::systemInterruptHandler().statistics().dump();
+            continue;
+        }
+#endif
+        kstd::printFormat("Key! (scancode 0x%02X)\n", scancode);
+    }
+}
+
+static kernel::WorkItem sKeyboardWork(printScancodes);
+
+/** The PS/2 keyboard, IRQ 1. */
+bool
+keyboardInterrupt(const x86::InterruptFrame&,
+                  void*)
+{
+    // Reading the data port acknowledges the byte. If the buffer is full the
+    // scancode is dropped.
+    sScancodes.push(kernel::io::inb(0x60));
+    kernel::DeferredWork::systemDeferredWork().schedule(sKeyboardWork);
+    return true;
+}
+
+/** Errors reported by the Local APIC, waiting to be printed. */
+static kstd::Atomic<u32> sAPICErrors;
+
+void
+printAPICErrors(kernel::WorkItem&)
+{
+    kstd::printFormat("APIC error: 0x%02X\n", unsigned(sAPICErrors.exchange(0)));
+}
+
+static kernel::WorkItem sAPICErrorWork(printAPICErrors);
+
+/** The Local APIC reports a delivery or acceptance error. */
+bool
+apicErrorInterrupt(const x86::InterruptFrame&,
+                   void* context)
+{
+    auto localAPIC = static_cast<x86::LocalAPIC*>(context);
+    // Writing ESR latches the errors into it.
+    localAPIC->write(x86::LocalAPIC::Register::ErrorStatus, 0);
+    sAPICErrors.fetchOr(localAPIC->read(x86::LocalAPIC::Register::ErrorStatus));
+    kernel::DeferredWork::systemDeferredWork().schedule(sAPICErrorWork);
+    return true;
+}
+
+#ifdef CONFIG_BENCHMARK_INTERRUPTS
+/**
+ * A spare vector that goes through the fast entry path. With the APIC, dispatch
+ * sends a needless EOI for it, which is harmless when nothing is in service.
+ */
+const u8 BenchmarkFastVector = 0xF0;
+/** #BP goes through the full entry path, and `int3` can't fault. */
+const u8 BenchmarkFullVector = 0x03;
+const u32 BenchmarkIterations = 1000;
+
+bool
+benchmarkInterrupt(const x86::InterruptFrame&,
+                   void*)
+{
+    return true;
+}
+
+
+/** Time a software interrupt through `Vector`. Returns min and average cycles. */
+template<u8 Vector>
+void
+timeInterruptRoundTrip(u64& minimum,
+                       u64& average)
+{
+    u64 total = 0;
+    minimum = ~u64(0);
+    for (u32 i = 0; i < BenchmarkIterations; i++) {
+        const u64 start = x86::rdtsc();
+        asm volatile("int %0" : : "i"(Vector) : "memory");
+        const u64 cycles = x86::rdtsc() - start;
+        total += cycles;
+        if (cycles < minimum) {
+            minimum = cycles;
+        }
+    }
+    average = total / BenchmarkIterations;
+}
+#endif
+
 } /* anonymous namespace */
 
 namespace x86 {
@@ -70,35 +178,56 @@ InterruptHandler::systemInterruptHandler()
 
 InterruptHandler::InterruptHandler()
     : mPIC(),
-      mIDT()
-{ }
+      mIDT(),
+      mUsingAPIC(false),
+      mLocalAPIC(),
+      mIOAPICs(),
+      mInterruptConfiguration(),
+      mHandlers(),
+      mHitCounts(),
+      mUnclaimedCounts(),
+      mFreeHandlers(nullptr),
+      mHandlersLock()
+#ifdef CONFIG_INTERRUPT_STATISTICS
+      , mStatistics()
+#endif
+{
+    for (usize i = 0; i < MaxHandlers; i++) {
+        mHandlerPool[i].next = mFreeHandlers;
+        mFreeHandlers = &mHandlerPool[i];
+    }
+}
 
 
 void
 InterruptHandler::initialize()
 {
-    // All interrupts start out as "unhandled"
     for (size_t i = 0; i < IDT::Size; i++) {
-        mIDT.setDescriptor(i, IDT::DescriptorSpec::exceptionHandler(0x8, &unhandledInterrupt));
+        mIDT.setDescriptor(i, IDT::DescriptorSpec::exceptionHandler(0x8, isrStubTable[i]));
     }
+    mIDT.load();
 
-    // System exceptions/faults
-    mIDT.setDescriptor(0x00, IDT::DescriptorSpec::exceptionHandler(0x8, &handleDEException));
-    mIDT.setDescriptor(0x02, IDT::DescriptorSpec::exceptionHandler(0x8, &handleNMIInterrupt));
-    mIDT.setDescriptor(0x08, IDT::DescriptorSpec::exceptionHandler(0x8, &handleDFException));
-    mIDT.setDescriptor(0x0D, IDT::DescriptorSpec::exceptionHandler(0x8, &handleGPException));
-
+    // Map hardware IRQs to interrupt vectors 32 through 48, all masked. Even
+    // if we go on to use the APICs this keeps a stray 8259 interrupt from
+    // landing on an exception vector.
+    mPIC.initialize(IRQBase, IRQBase + 8);
 
-    // Hardware interrupts
-    mIDT.setDescriptor(0x20, IDT::DescriptorSpec::exceptionHandler(0x8, &handleHardwareInterrupt0));
-    mIDT.setDescriptor(0x21, IDT::DescriptorSpec::exceptionHandler(0x8, &handleHardwareInterrupt1));
+    mUsingAPIC = initializeAPIC();
+    if (mUsingAPIC) {
+        registerHandler(APICErrorVector, apicErrorInterrupt, &mLocalAPIC);
+    }
 
-    mIDT.load();
+    registerIRQHandler(1, keyboardInterrupt, nullptr);
+}
 
-    mPIC.initialize(0x20, 0x28);  // Map hardware IRQs to interrupt vectors 32 through 48.
 
-    // Enable the keyboard interrupt.
-    mPIC.enableInterrupt(1, true);
+void
+InterruptHandler::initializeCPU()
+{
+    mIDT.load();
+    if (mUsingAPIC) {
+        mLocalAPIC.initialize(mInterruptConfiguration.localAPICAddress, SpuriousVector, APICErrorVector);
+    }
 }
 
 
@@ -106,7 +235,7 @@ void
 InterruptHandler::enableInterrupts()
     const
 {
-    asm("sti");
+    x86::enableInterrupts();
 }
 
 
@@ -114,94 +243,269 @@ void
 InterruptHandler::disableInterrupts()
     const
 {
-    asm("cli");
+    x86::disableInterrupts();
 }
 
 
-void
-InterruptHandler::dispatchException(uint8_t exception)
+bool
+InterruptHandler::registerHandler(u8 vector,
+                                  Handler handler,
+                                  void* context)
 {
-    auto& kernel = kernel::Kernel::systemKernel();
-    kernel.panic("Received %s exception.", sExceptionIdentifiers[exception]);
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mHandlersLock);
+
+    HandlerEntry* entry = mFreeHandlers;
+    if (!entry) {
+        return false;
+    }
+    mFreeHandlers = entry->next;
+
+    entry->next = nullptr;
+    entry->handler = handler;
+    entry->context = context;
+
+    // Append to the chain. The release store publishes the entry's fields
+    // before the entry itself, so dispatch() never sees a half-built one.
+    HandlerEntry** link = &mHandlers[vector];
+    while (*link) {
+        link = &(*link)->next;
+    }
+    kstd::rcuAssign(*link, entry);
+    return true;
+}
+
+
+bool
+InterruptHandler::registerIRQHandler(u8 irq,
+                                     Handler handler,
+                                     void* context)
+{
+    if (irq >= IRQCount || !registerHandler(IRQBase + irq, handler, context)) {
+        return false;
+    }
+    enableIRQ(irq);
+    return true;
+}
+
+
+bool
+InterruptHandler::unregisterHandler(u8 vector,
+                                    Handler handler,
+                                    void* context)
+{
+    HandlerEntry* entry = nullptr;
+    {
+        kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mHandlersLock);
+        for (HandlerEntry** link = &mHandlers[vector]; *link; link = &(*link)->next) {
+            if ((*link)->handler == handler && (*link)->context == context) {
+                entry = *link;
+                // The entry keeps its next pointer so a concurrent dispatch()
+                // standing on it can carry on down the chain.
+                kstd::rcuAssign(*link, entry->next);
+                break;
+            }
+        }
+    }
+    if (!entry) {
+        return false;
+    }
+    kstd::RCU::systemRCU().call(&entry->rcu, releaseHandlerEntry);
+    return true;
 }
 
 
 void
-InterruptHandler::dispatchHardwareInterrupt(uint8_t irq)
-{
-    switch (irq) {
-        case 0:
-            doTimerInterrupt();
-            break;
-        case 1:
-            doKeyboardInterrupt();
-            break;
-        default: {
-            auto& kernel = kernel::Kernel::systemKernel();
-            kernel.panic("Unhandled interrupt.");
-            break;
+InterruptHandler::dispatch(const InterruptFrame& frame)
+{
+#ifdef CONFIG_INTERRUPT_STATISTICS
+    // Before anything else, so the time counts all of dispatch.
+    const u64 start = rdtsc();
+#endif
+
+    // An idle CPU has dropped out of RCU grace periods. Rejoin before any
+    // handler goes looking at RCU-protected data.
+    kstd::RCU::systemRCU().exitIdle();
+
+    const u8 vector = frame.vector;
+    __atomic_fetch_add(&mHitCounts[vector], 1, __ATOMIC_RELAXED);
+
+    if (mUsingAPIC && vector == SpuriousVector) {
+        // Spurious APIC interrupts don't get an EOI.
+        return;
+    }
+    if (!mUsingAPIC && (vector == IRQBase + 7 || vector == IRQBase + 15)) {
+        // Spurious 8259 interrupts don't get an EOI either, and shouldn't
+        // panic for want of a handler.
+        if (mPIC.acknowledgeSpuriousInterrupt(vector - IRQBase)) {
+            return;
         }
     }
-    finishHardwareInterrupt(irq);
+
+    // Interrupt handlers can't pass through a quiescent state, so the chain
+    // is safe to walk without taking mHandlersLock.
+    bool claimed = false;
+    for (HandlerEntry* entry = kstd::rcuDereference(mHandlers[vector]);
+         entry;
+         entry = kstd::rcuDereference(entry->next)) {
+        claimed |= entry->handler(frame, entry->context);
+    }
+
+    if (!claimed) {
+        __atomic_fetch_add(&mUnclaimedCounts[vector], 1, __ATOMIC_RELAXED);
+        if (!mHandlers[vector]) {
+            unhandledInterrupt(frame);
+        }
+    }
+
+    finishHardwareInterrupt(vector);
+
+#ifdef CONFIG_INTERRUPT_STATISTICS
+    if (mStatistics.record(vector, start, rdtsc())) {
+        kernel::DeferredWork::systemDeferredWork().schedule(sStormWork);
+    }
+#endif
+
+    // Now that the interrupt is acknowledged, run deferred work before going
+    // back to whatever we interrupted. Exceptions don't do this: they can
+    // happen anywhere, including in the middle of deferred work.
+    if (vector >= IRQBase) {
+        kernel::DeferredWork::systemDeferredWork().run();
+        // Last of all, switch threads if this one's time is up.
+        kernel::Scheduler::systemScheduler().preemptIfNeeded();
+    }
 }
 
+#ifdef CONFIG_BENCHMARK_INTERRUPTS
+void
+InterruptHandler::benchmark()
+{
+    registerHandler(BenchmarkFullVector, benchmarkInterrupt, nullptr);
+    registerHandler(BenchmarkFastVector, benchmarkInterrupt, nullptr);
+
+    u64 fullMinimum, fullAverage, fastMinimum, fastAverage;
+    timeInterruptRoundTrip<BenchmarkFullVector>(fullMinimum, fullAverage);
+    timeInterruptRoundTrip<BenchmarkFastVector>(fastMinimum, fastAverage);
+
+    unregisterHandler(BenchmarkFullVector, benchmarkInterrupt, nullptr);
+    unregisterHandler(BenchmarkFastVector, benchmarkInterrupt, nullptr);
+
+    kstd::print("Interrupt round trip, full entry: min {} cycles, avg {} cycles\n", fullMinimum, fullAverage);
+    kstd::print("Interrupt round trip, fast entry: min {} cycles, avg {} cycles\n", fastMinimum, fastAverage);
+}
+#endif
+
 /*
  * Private
  */
 
-void
-InterruptHandler::doTimerInterrupt()
+bool
+InterruptHandler::initializeAPIC()
 {
-    auto& console = kernel::Console::systemConsole();
-    console.printString("Thyme!\n");
+    if (!LocalAPIC::isPresent() || !mInterruptConfiguration.load() || mInterruptConfiguration.numberOfIOAPICs == 0) {
+        return false;
+    }
+
+    mLocalAPIC.initialize(mInterruptConfiguration.localAPICAddress, SpuriousVector, APICErrorVector);
+    for (usize i = 0; i < mInterruptConfiguration.numberOfIOAPICs; i++) {
+        const auto& description = mInterruptConfiguration.ioAPICs[i];
+        mIOAPICs[i].initialize(description.address, description.interruptBase);
+    }
+
+    // Route the legacy IRQs to the same vectors the 8259s would have used, all
+    // to this CPU. They stay masked until someone registers a handler.
+    // An IRQ that's been moved by a source override takes its new GSI over
+    // from whichever IRQ is identity mapped to it -- usually IRQ 0 on GSI 2,
+    // in place of the cascade -- so that one isn't routed.
+    const u8 destination = mLocalAPIC.id();
+    for (u8 irq = 0; irq < IRQCount; irq++) {
+        const auto& isa = mInterruptConfiguration.isaInterrupts[irq];
+        if (isa.globalInterrupt == irq && isGSIOverridden(irq)) {
+            continue;
+        }
+        for (auto& ioapic : mIOAPICs) {
+            ioapic.route(isa.globalInterrupt, IRQBase + irq, destination, isa.isActiveLow, isa.isLevelTriggered);
+        }
+    }
+    return true;
+}
+
+
+bool
+InterruptHandler::isGSIOverridden(u32 gsi)
+    const
+{
+    for (u8 irq = 0; irq < IRQCount; irq++) {
+        const auto& isa = mInterruptConfiguration.isaInterrupts[irq];
+        if (isa.globalInterrupt == gsi && gsi != irq) {
+            return true;
+        }
+    }
+    return false;
 }
 
 
 void
-InterruptHandler::doKeyboardInterrupt()
+InterruptHandler::enableIRQ(u8 irq)
 {
-    // Quick 'n dirty read the scancode.
-    unsigned int c = 0;
-    do {
-        c = kernel::io::inw(0x60);
-        kstd::printFormat("Key! (scancode 0x%02X)\n", c);
-    } while (c == 0);
+    if (!mUsingAPIC) {
+        mPIC.enableInterrupt(irq, true);
+        return;
+    }
+    const u32 gsi = mInterruptConfiguration.isaInterrupts[irq].globalInterrupt;
+    for (auto& ioapic : mIOAPICs) {
+        ioapic.setMasked(gsi, false);
+    }
 }
 
 
 inline void
-InterruptHandler::finishHardwareInterrupt(uint8_t irq)
+InterruptHandler::finishHardwareInterrupt(u8 vector)
     const
 {
-    mPIC.endOfInterrupt(irq);
+    if (mUsingAPIC) {
+        // Everything from IRQBase up is delivered through the Local APIC.
+        if (vector >= IRQBase) {
+            mLocalAPIC.endOfInterrupt();
+        }
+    } else if (vector >= IRQBase && vector < IRQBase + IRQCount) {
+        mPIC.endOfInterrupt(vector - IRQBase);
+    }
 }
 
-} /* namespace x86 */
-
-/*
- * Interrupt handlers
- */
 
-extern "C"
 void
-doUnhandledInterrupt()
+InterruptHandler::unhandledInterrupt(const InterruptFrame& frame)
 {
     auto& kernel = kernel::Kernel::systemKernel();
-    kernel.panic("Unhandled interrupt.");
+    const usize numberOfExceptions = sizeof(sExceptionIdentifiers) / sizeof(sExceptionIdentifiers[0]);
+    if (frame.vector < numberOfExceptions) {
+        kernel.panic("Received %s exception. (error = 0x%08X, eip = 0x%08X)",
+                     sExceptionIdentifiers[frame.vector], unsigned(frame.errorCode), unsigned(frame.eip));
+    } else {
+        kernel.panic("Unhandled interrupt 0x%02X. (eip = 0x%08X)", unsigned(frame.vector), unsigned(frame.eip));
+    }
 }
 
 
-extern "C"
 void
-dispatchExceptionHandler(size_t vector)
+InterruptHandler::releaseHandlerEntry(kstd::RCUHead* head)
 {
-    x86::InterruptHandler::systemInterruptHandler().dispatchException(vector);
+    auto& self = systemInterruptHandler();
+    HandlerEntry* entry = reinterpret_cast<HandlerEntry*>(head);
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(self.mHandlersLock);
+    entry->next = self.mFreeHandlers;
+    self.mFreeHandlers = entry;
 }
 
+} /* namespace x86 */
+
+/*
+ * Interrupt handlers
+ */
 
 extern "C"
 void
-dispatchHardwareInterrupt(size_t irq)
+dispatchInterrupt(const x86::InterruptFrame* frame)
 {
-    x86::InterruptHandler::systemInterruptHandler().dispatchHardwareInterrupt(irq);
+    x86::InterruptHandler::systemInterruptHandler().dispatch(*frame);
 }
@@ -9,8 +9,15 @@
 #ifndef __INTERRUPTS_HH__
 #define __INTERRUPTS_HH__
 
+#include "ACPI.hh"
+#include "APIC.hh"
+#include "Attributes.hh"
 #include "Descriptors.hh"
+#include "InterruptStatistics.hh"
 #include "PIC.hh"
+#include "kstd/RCU.hh"
+#include "kstd/SpinLock.hh"
+#include "kstd/Types.hh"
 
 
 namespace kernel {
@@ -44,28 +51,164 @@ enum class Interrupt {
     // Interrupts 21 through 31 reserved
 };
 
+/**
+ * What the interrupt stubs in isr.S pass to the dispatcher: the vector, the
+ * error code (0 if the CPU didn't push one), and the state the CPU saved.
+ */
+struct InterruptFrame
+{
+    u32 vector;
+    u32 errorCode;
+    u32 eip;
+    u32 cs;
+    u32 eflags;
+} PACKED;
+
+
 struct InterruptHandler
 {
+    /**
+     * A handler for an interrupt vector. Handlers run with interrupts disabled.
+     * `context` is whatever was passed to registerHandler().
+     *
+     * @return `true` if the handler serviced the interrupt. Several handlers
+     *      can share a vector; every one of them is called, and the interrupt
+     *      is unclaimed if none returns `true`.
+     */
+    typedef bool (*Handler)(const InterruptFrame& frame, void* context);
+
+    /** Vector of legacy IRQ 0. IRQs 0 through 15 follow in order. */
+    static const u8 IRQBase = 0x20;
+    static const u8 IRQCount = 16;
+
+    /** Local APIC vectors. */
+    static const u8 APICErrorVector = 0xFE;
+    static const u8 SpuriousVector = 0xFF;
+
+    /** Number of handlers that can be registered at once, across all vectors. */
+    static const usize MaxHandlers = 64;
+
     static InterruptHandler& systemInterruptHandler();
 
     InterruptHandler();
 
+    /**
+     * Set up the IDT and the interrupt controllers. If the CPU has a Local APIC
+     * and ACPI describes the I/O APICs, the 8259s are masked and interrupts go
+     * through the APICs. Otherwise the 8259s are used.
+     */
     void initialize();
 
+    /**
+     * Set up interrupts on an application processor: load the IDT and enable
+     * its Local APIC. initialize() must have run on the boot CPU.
+     */
+    void initializeCPU();
+
+    /** `true` if interrupts are delivered by the APICs rather than the 8259s. */
+    bool isUsingAPIC() const { return mUsingAPIC; }
+
+    LocalAPIC& localAPIC() { return mLocalAPIC; }
+
+    /** What ACPI told us about the interrupt controllers and processors. Only valid if isUsingAPIC(). */
+    const acpi::InterruptConfiguration& interruptConfiguration() const { return mInterruptConfiguration; }
+
     void enableInterrupts() const;
     void disableInterrupts() const;
 
-    void dispatchException(uint8_t exception);
-    void dispatchHardwareInterrupt(uint8_t irq);
+    /**
+     * Add a handler for `vector`. Handlers for the same vector are called in
+     * the order they were registered.
+     *
+     * @return `false` if there's no room for another handler.
+     */
+    bool registerHandler(u8 vector, Handler handler, void* context);
+
+    /**
+     * Add a handler for legacy IRQ `irq` and unmask it at the interrupt
+     * controller.
+     * @see registerHandler()
+     */
+    bool registerIRQHandler(u8 irq, Handler handler, void* context);
+
+    /**
+     * Remove a handler added by registerHandler(). The handler may still be
+     * running on another CPU when this returns; its slot is reclaimed after an
+     * RCU grace period.
+     *
+     * @return `false` if no such handler was registered.
+     */
+    bool unregisterHandler(u8 vector, Handler handler, void* context);
+
+    /** Number of times `vector` has fired. */
+    u32 hitCount(u8 vector) const { return __atomic_load_n(&mHitCounts[vector], __ATOMIC_RELAXED); }
+
+    /** Number of times `vector` fired and no handler claimed it. */
+    u32 unclaimedCount(u8 vector) const { return __atomic_load_n(&mUnclaimedCounts[vector], __ATOMIC_RELAXED); }
+
+#ifdef CONFIG_INTERRUPT_STATISTICS
+    /** Latency and rate statistics. Press F12 to dump them. */
+    InterruptStatistics& statistics() { return mStatistics; }
+#endif
+
+    /** Called by the interrupt stubs for every vector. */
+    void dispatch(const InterruptFrame& frame);
+
+#ifdef CONFIG_BENCHMARK_INTERRUPTS
+    /**
+     * Time round trips through the full (exception) and fast (IRQ) interrupt
+     * entry paths with rdtsc and print the results. Interrupts must be
+     * enabled.
+     */
+    void benchmark();
+#endif
 
 private:
+    struct HandlerEntry
+    {
+        /** Must be first. See releaseHandlerEntry(). */
+        kstd::RCUHead rcu;
+        HandlerEntry* next;
+        Handler handler;
+        void* context;
+    };
+
     PIC mPIC;
     IDT mIDT;
 
-    void doTimerInterrupt();
-    void doKeyboardInterrupt();
-
-    void finishHardwareInterrupt(uint8_t irq) const;
+    bool mUsingAPIC;
+    LocalAPIC mLocalAPIC;
+    IOAPIC mIOAPICs[acpi::InterruptConfiguration::MaxIOAPICs];
+    acpi::InterruptConfiguration mInterruptConfiguration;
+
+    /** Handler chains, one per vector. Walked without a lock; see dispatch(). */
+    HandlerEntry* mHandlers[IDT::Size];
+    /** @{ Shared by every CPU, so only touched atomically. */
+    u32 mHitCounts[IDT::Size];
+    u32 mUnclaimedCounts[IDT::Size];
+    /** @} */
+
+    /** Storage for handler entries. There's no heap to get them from. */
+    HandlerEntry mHandlerPool[MaxHandlers];
+    HandlerEntry* mFreeHandlers;
+    /** Serializes changes to the handler chains and the free list. */
+    kstd::SpinLock mHandlersLock;
+
+#ifdef CONFIG_INTERRUPT_STATISTICS
+    InterruptStatistics mStatistics;
+#endif
+
+    /** Try to switch to the APICs. Returns `false` if we have to stay on the 8259s. */
+    bool initializeAPIC();
+    /** `true` if a source override moves some other ISA IRQ onto `gsi`. */
+    bool isGSIOverridden(u32 gsi) const;
+    /** Unmask legacy IRQ `irq` at whichever controller is in use. */
+    void enableIRQ(u8 irq);
+    /** Send the end of interrupt for `vector`, if it needs one. */
+    void finishHardwareInterrupt(u8 vector) const;
+    void unhandledInterrupt(const InterruptFrame& frame);
+
+    static void releaseHandlerEntry(kstd::RCUHead* head);
 };
 
 } /* namespace x86 */
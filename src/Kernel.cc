@@ -8,8 +8,14 @@
 
 #include <stdarg.h>
 #include "Kernel.hh"
+#include "CPU.hh"
+#include "DeferredWork.hh"
 #include "Interrupts.hh"
+#include "Scheduler.hh"
+#include "Timer.hh"
+#include "kstd/Format.hh"
 #include "kstd/PrintFormat.hh"
+#include "kstd/RCU.hh"
 
 namespace {
 
@@ -46,12 +52,12 @@ Kernel::initialize(const StartupInformation& startupInformation)
 
     kstd::printFormat("Loading Polka...\n");
 
-    kstd::printFormat("Kernel image: start = 0x%08lX, end = 0x%08lX, size = %ld bytes\n",
-                      startupInformation.kernelStart, startupInformation.kernelEnd,
-                      startupInformation.kernelSize());
+    kstd::print("Kernel image: start = 0x{:08X}, end = 0x{:08X}, size = {} bytes\n",
+                startupInformation.kernelStart, startupInformation.kernelEnd,
+                startupInformation.kernelSize());
 
     auto multiboot = startupInformation.multibootInformation;
-    kstd::printFormat("Multiboot: start = 0x%08lX\n", u32(multiboot));
+    kstd::print("Multiboot: start = 0x{:08X}\n", u32(multiboot));
     kstd::printFormat("Command line: \"%s\"\n", multiboot->commandLine());
 
     mMemoryManager.initialize(startupInformation);
@@ -76,6 +82,41 @@ Kernel::panic(const char* msg,
     halt();
 }
 
+
+void
+Kernel::idle()
+{
+    auto& rcu = kstd::RCU::systemRCU();
+    auto& deferredWork = DeferredWork::systemDeferredWork();
+    auto& timer = Timer::systemTimer();
+    auto& scheduler = Scheduler::systemScheduler();
+    for (;;) {
+        // Pick up anything left over when an interrupt ran out of budget.
+        while (deferredWork.run()) { }
+        rcu.quiescentState();
+
+        x86::disableInterrupts();
+        if (deferredWork.hasPendingWork()) {
+            x86::enableInterrupts();
+            continue;
+        }
+        if (scheduler.hasReadyThreads()) {
+            // A thread can become ready after the last halt's exitIdle()
+            // decided to leave the tick stopped. Whatever runs next needs it.
+            timer.exitIdle(true);
+            x86::enableInterrupts();
+            scheduler.yield();
+            continue;
+        }
+        timer.enterIdle();
+        rcu.enterIdle();
+        x86::enableInterruptsAndHalt();
+        rcu.exitIdle();
+        timer.exitIdle(deferredWork.hasPendingWork() || scheduler.hasReadyThreads());
+    }
+}
+
+
 Console&
 Kernel::console()
 {
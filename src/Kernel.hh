@@ -33,13 +33,24 @@ struct Kernel
      * Put up a panic screen and halt the system.
      * @see halt()
      */
-    void panic(const char* msg, ...);
+    void panic(const char* msg, ...) NORETURN;
 
     /** Disable interrupts and halt the system. You will never return from that place... */
     void halt() NORETURN;
 
+    /**
+     * The idle loop, run by each CPU's idle thread. Sleeps until an interrupt
+     * arrives, then runs any leftover deferred work, reports a quiescent state
+     * to RCU, and either yields to a ready thread or goes back to sleep. The
+     * tick is stopped while it sleeps, and only restarted if there's work
+     * waiting when it wakes. Grace periods don't wait for a sleeping CPU.
+     */
+    void idle() NORETURN;
+
     Console& console();
 
+    MemoryManager& memoryManager() { return mMemoryManager; }
+
 private:
     Console mConsole;
     MemoryManager mMemoryManager;
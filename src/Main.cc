@@ -7,11 +7,18 @@
  */
 
 #include <stddef.h>
+#include "Clock.hh"
 #include "Console.hh"
+#include "CrossCall.hh"
 #include "Descriptors.hh"
+#include "FPU.hh"
 #include "Interrupts.hh"
 #include "Kernel.hh"
 #include "Multiboot.hh"
+#include "SMP.hh"
+#include "Scheduler.hh"
+#include "Timer.hh"
+#include "kstd/Format.hh"
 #include "kstd/Types.hh"
 
 #if defined(__linux__)
@@ -49,7 +56,43 @@ kmain(multiboot::Information *information,
     auto& interruptHandler = x86::InterruptHandler::systemInterruptHandler();
     interruptHandler.initialize();
     interruptHandler.enableInterrupts();
-    console.printString("Interrupts enabled\n");
+    console.printString(interruptHandler.isUsingAPIC() ? "Interrupts enabled (APIC)\n" : "Interrupts enabled (8259 PIC)\n");
 
-    kernel::Kernel::systemKernel().halt();
+    auto& clock = kernel::Clock::systemClock();
+    clock.initialize();
+    kstd::print("TSC: {} kHz, invariant = {}\n", u32(clock.tscFrequency() / 1000), clock.isTSCInvariant());
+
+    // From here on, kmain is the boot thread.
+    auto& scheduler = kernel::Scheduler::systemScheduler();
+    scheduler.initialize();
+
+    auto& fpu = kernel::FPU::systemFPU();
+    fpu.initialize();
+    console.printString(fpu.isAvailable() ? "FPU: lazy FXSAVE switching\n" : "FPU: no FXSAVE, disabled\n");
+
+    auto& timer = kernel::Timer::systemTimer();
+    timer.initialize();
+    if (timer.isUsingLocalAPIC()) {
+        kstd::print("Timer: {} Hz, Local APIC timer at {} kHz\n", kernel::TicksPerSecond, timer.localAPICFrequency() / 1000);
+    } else {
+        kstd::print("Timer: {} Hz, PIT\n", kernel::TicksPerSecond);
+    }
+
+    kernel::CrossCall::systemCrossCall().initialize();
+
+    auto& smp = kernel::SMP::systemSMP();
+    smp.startApplicationProcessors();
+    kstd::print("CPUs: {} online\n", smp.numberOfCPUs());
+
+#ifdef CONFIG_BENCHMARK_INTERRUPTS
+    auto benchmark = scheduler.spawn("benchmark", [](void*) {
+        x86::InterruptHandler::systemInterruptHandler().benchmark();
+    }, nullptr);
+    if (benchmark) {
+        scheduler.detach(*benchmark);
+    }
+#endif
+
+    // Boot is done. The idle thread takes it from here.
+    scheduler.exit();
 }
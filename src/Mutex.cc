@@ -0,0 +1,159 @@
+/* Mutex.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Sleeping locks.
+ */
+
+#include "Mutex.hh"
+#include "CPU.hh"
+#include "Kernel.hh"
+#include "SMP.hh"
+#include "Scheduler.hh"
+#include "Thread.hh"
+
+namespace {
+
+/** `true` if there's another CPU that could let go of something while we spin. */
+inline bool
+canSpin()
+{
+    return kernel::SMP::systemSMP().numberOfCPUs() > 1;
+}
+
+} /* anonymous namespace */
+
+namespace kernel {
+
+/*
+ * Mutex
+ */
+
+Mutex::Mutex()
+    : mOwner(nullptr),
+      mWaiters()
+{ }
+
+
+void
+Mutex::lock()
+{
+    if (tryLock() || spinWhileOwnerRuns()) {
+        return;
+    }
+    mWaiters.waitUntil([this]() { return tryLock(); });
+}
+
+
+bool
+Mutex::tryLock()
+{
+    Thread* expected = nullptr;
+    return mOwner.compareExchange(expected, Scheduler::systemScheduler().current());
+}
+
+
+void
+Mutex::unlock()
+{
+    Thread* current = Scheduler::systemScheduler().current();
+    if (mOwner.load(kstd::MemoryOrder::Relaxed) != current) {
+        Kernel::systemKernel().panic("Thread %d (%s) unlocked a mutex it doesn't hold\n", current->id(), current->name());
+    }
+    mOwner.store(nullptr);
+    mWaiters.wakeOne();
+}
+
+
+bool
+Mutex::spinWhileOwnerRuns()
+{
+    if (!canSpin()) {
+        return false;
+    }
+    for (u32 i = 0; i < MaxSpins; i++) {
+        Thread* owner = mOwner.load(kstd::MemoryOrder::Relaxed);
+        if (!owner) {
+            if (tryLock()) {
+                return true;
+            }
+        } else if (owner->state() != Thread::State::Running) {
+            // It won't let go until it's back on a CPU. Sleep instead.
+            return false;
+        }
+        x86::pause();
+    }
+    return false;
+}
+
+/*
+ * Semaphore
+ */
+
+Semaphore::Semaphore(u32 count)
+    : mCount(count),
+      mWaiters()
+{ }
+
+
+void
+Semaphore::down()
+{
+    if (tryDown()) {
+        return;
+    }
+    if (canSpin()) {
+        for (u32 i = 0; i < Mutex::MaxSpins; i++) {
+            x86::pause();
+            if (tryDown()) {
+                return;
+            }
+        }
+    }
+    mWaiters.waitUntil([this]() { return tryDown(); });
+}
+
+
+bool
+Semaphore::tryDown()
+{
+    u32 count = mCount.load(kstd::MemoryOrder::Relaxed);
+    while (count != 0) {
+        if (mCount.compareExchange(count, count - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void
+Semaphore::up()
+{
+    mCount.fetchAdd(1);
+    mWaiters.wakeOne();
+}
+
+/*
+ * ConditionVariable
+ */
+
+ConditionVariable::ConditionVariable()
+    : mWaiters()
+{ }
+
+
+void
+ConditionVariable::wait(Mutex& mutex)
+{
+    // We're on the queue before the mutex is let go, so a signal from whoever
+    // takes it next finds us.
+    mWaiters.sleep([&mutex]() {
+        mutex.unlock();
+        return true;
+    });
+    mutex.lock();
+}
+
+} /* namespace kernel */
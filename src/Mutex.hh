@@ -0,0 +1,128 @@
+/* Mutex.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Sleeping locks: mutexes, semaphores, and condition variables, built on
+ * WaitQueue. Unlike a SpinLock, a thread that can't get one of these goes to
+ * sleep, and takes no CPU time until it can. They can only be used by threads,
+ * with interrupts enabled, and never from interrupt handlers -- except
+ * Semaphore::up() and ConditionVariable's signal() and broadcast(), which
+ * don't block.
+ *
+ * Going to sleep and being woken costs two context switches, which is a lot
+ * for a lock held across a few lines. So a thread that finds a Mutex held by a
+ * thread that's running on another CPU spins for a while first, on the bet
+ * that it'll be let go before a switch would be done. Semaphores spin for a
+ * while too. With only one CPU, nobody spins.
+ *
+ * Mutex works with kstd::LockGuard.
+ */
+
+#ifndef __MUTEX_HH__
+#define __MUTEX_HH__
+
+#include "WaitQueue.hh"
+#include "kstd/Atomic.hh"
+#include "kstd/Types.hh"
+
+namespace kernel {
+
+struct Thread;
+
+struct Mutex
+{
+    /** Most times to check again before going to sleep. */
+    static const u32 MaxSpins = 1000;
+
+    Mutex();
+
+    void lock();
+
+    /** Take the mutex only if nobody holds it. Returns `true` if it was taken. */
+    bool tryLock();
+
+    /** Let go of the mutex. Only its owner can; anyone else panics. */
+    void unlock();
+
+    bool isLocked() const { return owner() != nullptr; }
+
+    /** The thread holding the mutex, or null. */
+    Thread* owner() const { return mOwner.load(kstd::MemoryOrder::Relaxed); }
+
+private:
+    kstd::Atomic<Thread*> mOwner;
+    WaitQueue mWaiters;
+
+    /**
+     * Spin while the owner's running, up to MaxSpins times.
+     * @return `true` if we got the mutex.
+     */
+    bool spinWhileOwnerRuns();
+
+    Mutex(const Mutex& other) = delete;
+    Mutex& operator=(const Mutex& other) = delete;
+};
+
+
+/** A counting semaphore. */
+struct Semaphore
+{
+    explicit Semaphore(u32 count = 0);
+
+    /** Take one, sleeping until there's one to take. */
+    void down();
+
+    /** Take one only if there's one to take. Returns `true` if it was taken. */
+    bool tryDown();
+
+    /** Put one back, and wake a thread waiting for it. Safe to call from interrupt handlers. */
+    void up();
+
+    u32 count() const { return mCount.load(kstd::MemoryOrder::Relaxed); }
+
+private:
+    kstd::Atomic<u32> mCount;
+    WaitQueue mWaiters;
+
+    Semaphore(const Semaphore& other) = delete;
+    Semaphore& operator=(const Semaphore& other) = delete;
+};
+
+
+/**
+ * A condition variable, for waiting on a condition protected by a Mutex.
+ * Check the condition in a loop: a woken thread has to take the mutex again,
+ * and someone else may get it first and change things.
+ *
+ *     kstd::LockGuard<Mutex> guard(mutex);
+ *     while (!isReady) {
+ *         condition.wait(mutex);
+ *     }
+ */
+struct ConditionVariable
+{
+    ConditionVariable();
+
+    /**
+     * Let go of `mutex`, which the caller holds, sleep until signaled, and
+     * take it again. No signal sent after the mutex is let go is missed.
+     */
+    void wait(Mutex& mutex);
+
+    /** Wake one waiting thread. */
+    void signal() { mWaiters.wakeOne(); }
+
+    /** Wake every waiting thread. */
+    void broadcast() { mWaiters.wakeAll(); }
+
+private:
+    WaitQueue mWaiters;
+
+    ConditionVariable(const ConditionVariable& other) = delete;
+    ConditionVariable& operator=(const ConditionVariable& other) = delete;
+};
+
+} /* namespace kernel */
+
+#endif /* __MUTEX_HH__ */
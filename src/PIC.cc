@@ -35,6 +35,11 @@ enum OCW2 {
     RotateOnSpecificEOICommand = (7 << 5),
 };
 
+enum OCW3 {
+    ReadIRR = 0x0A,
+    ReadISR = 0x0B,
+};
+
 namespace {
     const struct {
         uint16_t command;
@@ -104,6 +109,28 @@ PIC::endOfInterrupt(uint8_t irq)
 }
 
 
+bool
+PIC::acknowledgeSpuriousInterrupt(uint8_t irq)
+    const
+{
+    if (irq != 7 && irq != 15) {
+        return false;
+    }
+    // A real IRQ 7 or 15 is in service on its chip. A spurious one isn't.
+    const uint16_t command = irq == 7 ? PIC1.command : PIC2.command;
+    kernel::io::outb(command, OCW3::ReadISR);
+    if (kernel::io::inb(command) & (1 << 7)) {
+        return false;
+    }
+    // It did come in through the master on the cascade line, and that part
+    // was real.
+    if (irq == 15) {
+        kernel::io::outb(PIC1.command, OCW2::NonSpecificEOI);
+    }
+    return true;
+}
+
+
 void
 PIC::enableInterrupt(uint8_t irq,
                      bool enabled)
@@ -58,6 +58,17 @@ struct PIC
      */
     void endOfInterrupt(uint8_t irq) const;
 
+    /**
+     * The 8259s raise IRQ 7 or IRQ 15 when an interrupt goes away before
+     * they can say which one it was, even if those lines are masked. Check
+     * the in-service register to tell if `irq` was one of those. A spurious
+     * IRQ 7 gets no EOI; for a spurious IRQ 15 only the master gets one, and
+     * this sends it.
+     *
+     * @return `true` if `irq` was spurious, and there's nothing more to do.
+     */
+    bool acknowledgeSpuriousInterrupt(uint8_t irq) const;
+
     /**
      * Enable or disable the given IRQ. This is done by setting a mask bit in
      * the PIC's IMR register. If the bit is set, the IRQ is ignored.
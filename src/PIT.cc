@@ -0,0 +1,172 @@
+/* PIT.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Implementation of the x86::PIT class.
+ */
+
+#include "PIT.hh"
+#include "IO.hh"
+
+namespace {
+
+enum Port {
+    Channel0 = 0x40,
+    Channel2 = 0x42,
+    Command = 0x43,
+    /** Keyboard controller port B. Gates channel 2 and reads back its output. */
+    PortB = 0x61,
+};
+
+/** Port B bits. */
+enum PortBBits {
+    Channel2Gate = 1 << 0,
+    SpeakerEnable = 1 << 1,
+    Channel2Output = 1 << 5,
+};
+
+/** Mode/command register bits. */
+enum CommandBits {
+    SelectChannel0 = 0 << 6,
+    SelectChannel2 = 2 << 6,
+    AccessLatch = 0 << 4,          // Latch the count for reading
+    AccessLowHigh = 3 << 4,        // Low byte, then high byte
+    InterruptOnTerminalCount = 0 << 1,  // Mode 0: one-shot
+    RateGenerator = 2 << 1,             // Mode 2: periodic
+    Binary = 0,
+};
+
+void
+writeCount(u16 port,
+           u32 count)
+{
+    // A count of 0 means 65536.
+    kernel::io::outb(port, count & 0xFF);
+    kernel::io::outb(port, (count >> 8) & 0xFF);
+}
+
+} /* anonymous namespace */
+
+namespace x86 {
+
+/*
+ * Static
+ */
+
+PIT&
+PIT::systemPIT()
+{
+    static PIT sPIT;
+    return sPIT;
+}
+
+
+u32
+PIT::countForNanoseconds(u64 nanoseconds)
+{
+    // MaxCount is about 55 ms. Anything longer gets clamped, and this keeps
+    // the multiply from overflowing.
+    if (nanoseconds >= 60000000) {
+        return MaxCount;
+    }
+    const u64 count = (nanoseconds * BaseFrequency + 999999999) / 1000000000;
+    return count > MaxCount ? MaxCount : u32(count);
+}
+
+/*
+ * Public
+ */
+
+PIT::PIT()
+    : mFrequency(0)
+{ }
+
+
+u32
+PIT::startPeriodic(u32 frequency)
+{
+    u32 divisor = (BaseFrequency + frequency / 2) / frequency;
+    if (divisor < 2) {
+        // Mode 2 doesn't work with a divisor of 1.
+        divisor = 2;
+    } else if (divisor > MaxCount) {
+        divisor = MaxCount;
+    }
+
+    kernel::io::outb(Command, SelectChannel0 | AccessLowHigh | RateGenerator | Binary);
+    writeCount(Channel0, divisor);
+
+    mFrequency = BaseFrequency / divisor;
+    return mFrequency;
+}
+
+
+void
+PIT::startOneShot(u32 count)
+{
+    if (count == 0) {
+        count = 1;
+    } else if (count > MaxCount) {
+        count = MaxCount;
+    }
+    kernel::io::outb(Command, SelectChannel0 | AccessLowHigh | InterruptOnTerminalCount | Binary);
+    writeCount(Channel0, count);
+    mFrequency = 0;
+}
+
+
+void
+PIT::stop()
+{
+    // Writing the mode without a count stops the counter until one is loaded.
+    kernel::io::outb(Command, SelectChannel0 | AccessLowHigh | InterruptOnTerminalCount | Binary);
+    mFrequency = 0;
+}
+
+
+void
+PIT::startChannel2(u32 count)
+{
+    if (count == 0) {
+        count = 1;
+    } else if (count > MaxCount) {
+        count = MaxCount;
+    }
+    // Gate channel 2 off with the speaker disconnected while it's programmed,
+    // then gate it on to start counting.
+    const u8 portB = kernel::io::inb(PortB) & ~u8(Channel2Gate | SpeakerEnable);
+    kernel::io::outb(PortB, portB);
+    kernel::io::outb(Command, SelectChannel2 | AccessLowHigh | InterruptOnTerminalCount | Binary);
+    writeCount(Channel2, count);
+    kernel::io::outb(PortB, portB | Channel2Gate);
+}
+
+
+bool
+PIT::hasChannel2Expired()
+    const
+{
+    // In mode 0 the output goes high when the count reaches zero.
+    return (kernel::io::inb(PortB) & Channel2Output) != 0;
+}
+
+
+void
+PIT::stopChannel2()
+{
+    kernel::io::outb(PortB, kernel::io::inb(PortB) & ~u8(Channel2Gate | SpeakerEnable));
+}
+
+
+u16
+PIT::readCount()
+    const
+{
+    kernel::io::outb(Command, SelectChannel0 | AccessLatch);
+    const u8 low = kernel::io::inb(Channel0);
+    const u8 high = kernel::io::inb(Channel0);
+    return (u16(high) << 8) | low;
+}
+
+} /* namespace x86 */
@@ -0,0 +1,79 @@
+/* PIT.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * The 8253/8254 Programmable Interval Timer.
+ */
+
+#ifndef __PIT_HH__
+#define __PIT_HH__
+
+#include "kstd/Types.hh"
+
+namespace x86 {
+
+/**
+ * The PIT has three 16-bit counters driven by a 1.193182 MHz clock. Channel 0
+ * is wired to IRQ 0 and is used for the system tick. Channel 1 is unused on
+ * modern hardware, and channel 2 drives the PC speaker, but can be gated and
+ * read back through port 0x61, which makes it handy for calibrating other
+ * clocks.
+ */
+struct PIT
+{
+    /** Frequency of the PIT's input clock, in Hz. */
+    static const u32 BaseFrequency = 1193182;
+
+    /** Longest count the 16-bit counter can hold. A count of 0 means 65536. */
+    static const u32 MaxCount = 65536;
+
+    static PIT& systemPIT();
+
+    PIT();
+
+    /**
+     * Program channel 0 as a rate generator (mode 2) that interrupts
+     * `frequency` times a second. The divisor is rounded, so the actual rate
+     * may differ a little.
+     *
+     * @return The actual frequency.
+     */
+    u32 startPeriodic(u32 frequency);
+
+    /**
+     * Program channel 0 to interrupt once (mode 0) after `count` input clocks.
+     * Counts larger than MaxCount are clamped.
+     */
+    void startOneShot(u32 count);
+
+    /** Stop channel 0. It won't interrupt until it's programmed again. */
+    void stop();
+
+    /** Read channel 0's current count. */
+    u16 readCount() const;
+
+    /**
+     * @defgroup Channel 2
+     * Count down on channel 2 without an interrupt, for calibrating other
+     * clocks. Poll hasChannel2Expired() to find out when it's done.
+     * @{
+     */
+    void startChannel2(u32 count);
+    bool hasChannel2Expired() const;
+    void stopChannel2();
+    /** @} */
+
+    /** Frequency of the periodic interrupt, or 0 if it isn't running periodically. */
+    u32 frequency() const { return mFrequency; }
+
+    /** Convert nanoseconds to PIT input clocks, rounding up. */
+    static u32 countForNanoseconds(u64 nanoseconds);
+
+private:
+    u32 mFrequency;
+};
+
+} /* namespace x86 */
+
+#endif /* __PIT_HH__ */
@@ -0,0 +1,68 @@
+/* PerCPU.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Per-CPU data areas, and the CPU number kept in them.
+ */
+
+#include "PerCPU.hh"
+#include "CPU.hh"
+#include "Descriptors.hh"
+#include "kstd/Memory.hh"
+
+// Linker script defined symbols. See linker.ld.
+extern u8 perCPUStart[];
+extern u8 perCPUEnd[];
+
+namespace {
+
+/** Distance from the template to each CPU's copy. */
+static uptr sOffsets[x86::MaxCPUs];
+
+} /* anonymous namespace */
+
+namespace x86 {
+
+PER_CPU PerCPU<uptr> perCPUOffset;
+PER_CPU PerCPU<usize> cpuNumber;
+
+
+uptr
+perCPUOffsetFor(usize cpu)
+{
+    return sOffsets[cpu];
+}
+
+
+usize
+perCPUSize()
+{
+    return perCPUEnd - perCPUStart;
+}
+
+
+void
+initializePerCPUArea(usize cpu,
+                     void* area,
+                     GDT& gdt)
+{
+    kstd::Memory::copy(area, perCPUStart, perCPUSize());
+    const uptr offset = uptr(area) - uptr(perCPUStart);
+    sOffsets[cpu] = offset;
+    perCPUOffset.forCPU(cpu) = offset;
+    cpuNumber.forCPU(cpu) = cpu;
+
+    // If the area is below the template, the base wraps around. With a 4 GB
+    // limit, addresses wrap right back.
+    gdt.setDescriptor(GDT::PerCPUIndex + cpu, GDT::DescriptorSpec::kernelSegment(offset, 0xFFFFFFFF, GDT::Type::DataRW));
+}
+
+
+void
+loadPerCPUArea(usize cpu)
+{
+    asm volatile("movw %0, %%gs" : : "r"(GDT::perCPUSelector(cpu)) : "memory");
+}
+
+} /* namespace x86 */
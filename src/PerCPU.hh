@@ -0,0 +1,135 @@
+/* PerCPU.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Per-CPU data, reached through the GS segment.
+ *
+ * Per-CPU variables are PerCPU<T> globals marked PER_CPU, which the linker
+ * gathers into the .percpu section. That section is only a template: each CPU
+ * gets a copy of it, and loads GS with a data segment based at the distance
+ * from the template to its copy. %gs:variable is then that CPU's own copy of
+ * variable, with no table lookup and no CPU number needed to find it.
+ *
+ *     PER_CPU static x86::PerCPU<u32> sCount;
+ *
+ *     sCount.add(1);
+ *     u32 count = sCount.load();
+ *
+ * load(), store(), add() and subtract() are single instructions, so they need
+ * no lock, and an interrupt can't land halfway through one. Nothing but
+ * forCPU() touches another CPU's copy, and CPUs never share a cache line
+ * through one.
+ *
+ * Until a CPU loads its segment, GS is the flat kernel data segment, and
+ * per-CPU variables reach the template itself. That's only the boot CPU, early
+ * on. The copies are made bytewise, so a T mustn't point into itself.
+ */
+
+#ifndef __PERCPU_HH__
+#define __PERCPU_HH__
+
+#include "Attributes.hh"
+#include "kstd/Types.hh"
+
+namespace x86 {
+
+struct GDT;
+
+/** Distance from the template to this CPU's copy of the per-CPU data. */
+inline uptr thisCPUOffset();
+
+/** Distance from the template to `cpu`'s copy of the per-CPU data. */
+uptr perCPUOffsetFor(usize cpu);
+
+
+template<typename T>
+struct PerCPU
+{
+    PerCPU()
+        : mValue()
+    { }
+
+    explicit
+    PerCPU(const T& value)
+        : mValue(value)
+    { }
+
+    /** This CPU's copy. Only good for as long as the caller can't move to another CPU. */
+    T& thisCPU() { return *reinterpret_cast<T*>(uptr(&mValue) + thisCPUOffset()); }
+
+    /** `cpu`'s copy. It's up to the caller to keep that CPU from racing with it. */
+    T& forCPU(usize cpu) { return *reinterpret_cast<T*>(uptr(&mValue) + perCPUOffsetFor(cpu)); }
+
+    /**
+     * @defgroup Single Instruction
+     * Operations on this CPU's copy, each a single instruction. Only for
+     * integers and pointers, no wider than a word.
+     * @{
+     */
+    T
+    load()
+        const
+    {
+        static_assert(sizeof(T) <= sizeof(uptr), "Too wide for one instruction");
+        T value;
+        asm volatile("mov %%gs:%1, %0" : "=q"(value) : "m"(mValue));
+        return value;
+    }
+
+    void
+    store(T value)
+    {
+        static_assert(sizeof(T) <= sizeof(uptr), "Too wide for one instruction");
+        asm volatile("mov %1, %%gs:%0" : "=m"(mValue) : "q"(value));
+    }
+
+    void
+    add(T value)
+    {
+        static_assert(sizeof(T) <= sizeof(uptr), "Too wide for one instruction");
+        asm volatile("add %1, %%gs:%0" : "+m"(mValue) : "q"(value));
+    }
+
+    void
+    subtract(T value)
+    {
+        static_assert(sizeof(T) <= sizeof(uptr), "Too wide for one instruction");
+        asm volatile("sub %1, %%gs:%0" : "+m"(mValue) : "q"(value));
+    }
+    /** @} */
+
+private:
+    /** The template's copy. Only reached directly through GS. */
+    T mValue;
+};
+
+
+/** Each CPU's copy holds the distance to itself. */
+extern PerCPU<uptr> perCPUOffset;
+
+inline uptr
+thisCPUOffset()
+{
+    return perCPUOffset.load();
+}
+
+
+/** Size of a CPU's copy of the per-CPU data, in bytes. */
+usize perCPUSize();
+
+/**
+ * Make `cpu`'s copy of the per-CPU data at `area`, which has room for
+ * perCPUSize() bytes, and point its per-CPU segment in `gdt` at it. The whole
+ * template is copied before this CPU's offset and number are set in it. The
+ * template has to be pristine, so do this for the boot CPU before any
+ * per-CPU variable is written.
+ */
+void initializePerCPUArea(usize cpu, void* area, GDT& gdt);
+
+/** Load GS with `cpu`'s per-CPU segment. Call on `cpu`, after initializePerCPUArea(). */
+void loadPerCPUArea(usize cpu);
+
+} /* namespace x86 */
+
+#endif /* __PERCPU_HH__ */
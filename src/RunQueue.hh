@@ -0,0 +1,106 @@
+/* RunQueue.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * A run queue with a FIFO per priority level, and a bitmap of the levels that
+ * have threads waiting. Finding the highest priority ready thread is one
+ * `bsf` on the bitmap, however many threads are queued. Each CPU has one.
+ */
+
+#ifndef __RUNQUEUE_HH__
+#define __RUNQUEUE_HH__
+
+#include "CPU.hh"
+#include "Thread.hh"
+#include "kstd/List.hh"
+#include "kstd/Types.hh"
+
+namespace kernel {
+
+struct RunQueue
+{
+    RunQueue()
+        : mLevels(),
+          mNonEmptyLevels(0),
+          mSize(0)
+    { }
+
+    bool isEmpty() const { return mNonEmptyLevels == 0; }
+    usize size() const { return mSize; }
+
+    /** Priority of the best thread on the queue. Only meaningful if it isn't empty. */
+    u32 highestPriority() const { return x86::bitScanForward(mNonEmptyLevels); }
+
+    /** Queue `thread` behind the others at its priority. */
+    void
+    pushBack(Thread& thread)
+    {
+        const u32 priority = thread.priority();
+        mLevels[priority].pushBack(thread);
+        mNonEmptyLevels |= 1u << priority;
+        mSize++;
+    }
+
+    /** Take the first thread at the highest priority, or null if there aren't any. */
+    Thread*
+    popFront()
+    {
+        if (isEmpty()) {
+            return nullptr;
+        }
+        const u32 priority = highestPriority();
+        Thread* thread = mLevels[priority].popFront();
+        if (mLevels[priority].isEmpty()) {
+            mNonEmptyLevels &= ~(1u << priority);
+        }
+        mSize--;
+        return thread;
+    }
+
+    /** Take `thread`, which must be on this queue, off it. */
+    void
+    remove(Thread& thread)
+    {
+        const u32 priority = thread.priority();
+        mLevels[priority].remove(thread);
+        if (mLevels[priority].isEmpty()) {
+            mNonEmptyLevels &= ~(1u << priority);
+        }
+        mSize--;
+    }
+
+    /**
+     * The thread that would wait longest here, of those `canTake` accepts:
+     * the last one at the lowest priority, working up from there. Null if
+     * there isn't one. Leaves it on the queue.
+     */
+    template<typename Predicate>
+    Thread*
+    findLast(Predicate canTake)
+        const
+    {
+        u32 levels = mNonEmptyLevels;
+        while (levels != 0) {
+            const u32 priority = x86::bitScanReverse(levels);
+            const auto& level = mLevels[priority];
+            for (Thread* thread = level.back(); thread; thread = level.prev(*thread)) {
+                if (canTake(*thread)) {
+                    return thread;
+                }
+            }
+            levels &= ~(1u << priority);
+        }
+        return nullptr;
+    }
+
+private:
+    kstd::List<Thread, &Thread::node> mLevels[Thread::PriorityLevels];
+    /** Bit n is set if level n has threads. */
+    u32 mNonEmptyLevels;
+    usize mSize;
+};
+
+} /* namespace kernel */
+
+#endif /* __RUNQUEUE_HH__ */
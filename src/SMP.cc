@@ -0,0 +1,218 @@
+/* SMP.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Application processor startup, and telling CPUs apart.
+ */
+
+#include "SMP.hh"
+#include "APIC.hh"
+#include "Attributes.hh"
+#include "Clock.hh"
+#include "FPU.hh"
+#include "Interrupts.hh"
+#include "Kernel.hh"
+#include "PerCPU.hh"
+#include "Scheduler.hh"
+#include "Thread.hh"
+#include "Timer.hh"
+#include "kstd/Format.hh"
+#include "kstd/Memory.hh"
+#include "kstd/RCU.hh"
+
+extern "C" {
+    // See trampoline.S.
+    extern const u8 apTrampolineStart[];
+    extern const u8 apTrampolineParameters[];
+    extern const u8 apTrampolineEnd[];
+}
+
+namespace {
+
+static kernel::SMP sSMP;
+
+/**
+ * Where the trampoline is copied to. It has to be page aligned and in the
+ * first megabyte, which the frame allocator never hands out. Must match
+ * TrampolineAddress in trampoline.S.
+ */
+const uptr TrampolineAddress = 0x8000;
+
+/** What the boot CPU fills in at apTrampolineParameters. */
+struct TrampolineParameters
+{
+    /** What SGDT stores, and LGDT loads. */
+    u16 gdtLimit;
+    u32 gdtBase;
+    u32 stack;
+    u32 entry;
+    /** Passed to the entry point. */
+    u32 cpu;
+} PACKED;
+
+/** @{ Delays from the MultiProcessor Specification's startup sequence. */
+const u64 InitDelayNanoseconds = 10000000;
+const u64 StartupDelayNanoseconds = 200000;
+/** @} */
+
+/** How long to give an application processor to check in after its last startup IPI. */
+const u64 StartTimeoutNanoseconds = 100000000;
+
+
+/** Spin for `nanoseconds`. */
+void
+delay(u64 nanoseconds)
+{
+    auto& clock = kernel::Clock::systemClock();
+    const u64 end = clock.nowNanoseconds() + nanoseconds;
+    while (clock.nowNanoseconds() < end) {
+        x86::pause();
+    }
+}
+
+
+/**
+ * Spin until `flag` is set or `nanoseconds` have passed.
+ * @return The flag.
+ */
+bool
+waitFor(const kstd::Atomic<bool>& flag,
+        u64 nanoseconds)
+{
+    auto& clock = kernel::Clock::systemClock();
+    const u64 end = clock.nowNanoseconds() + nanoseconds;
+    while (!flag.load(kstd::MemoryOrder::Acquire)) {
+        if (clock.nowNanoseconds() >= end) {
+            return false;
+        }
+        x86::pause();
+    }
+    return true;
+}
+
+} /* anonymous namespace */
+
+namespace kernel {
+
+/*
+ * Static
+ */
+
+SMP&
+SMP::systemSMP()
+{
+    return sSMP;
+}
+
+/*
+ * Public
+ */
+
+SMP::SMP()
+    : mAPICIDs(),
+      mNumberOfCPUs(1),
+      mIsStarted(false)
+{ }
+
+
+void
+SMP::startApplicationProcessors()
+{
+    auto& interruptHandler = x86::InterruptHandler::systemInterruptHandler();
+    if (!interruptHandler.isUsingAPIC()) {
+        return;
+    }
+    const auto& configuration = interruptHandler.interruptConfiguration();
+    auto& localAPIC = interruptHandler.localAPIC();
+
+    // Number the CPUs. The boot CPU is 0, wherever it is in the MADT.
+    const u8 bootID = localAPIC.id();
+    usize count = 1;
+    mAPICIDs[0] = bootID;
+    for (usize i = 0; i < configuration.numberOfProcessors; i++) {
+        const u8 id = configuration.processorAPICIds[i];
+        if (id != bootID) {
+            mAPICIDs[count++] = id;
+        }
+    }
+    if (count == 1) {
+        return;
+    }
+
+    auto trampoline = reinterpret_cast<u8*>(TrampolineAddress);
+    kstd::Memory::copy(trampoline, apTrampolineStart, apTrampolineEnd - apTrampolineStart);
+    auto parameters = reinterpret_cast<TrampolineParameters*>(trampoline + (apTrampolineParameters - apTrampolineStart));
+    // The application processors go straight onto the GDT we're using.
+    asm volatile("sgdt %0" : "=m"(*parameters));
+    parameters->entry = u32(applicationProcessorEntry);
+
+    for (usize cpu = 1; cpu < count; cpu++) {
+        // They share the trampoline, so one at a time. Numbers have to stay
+        // dense, so the first one that doesn't come up is the last one tried.
+        if (!startApplicationProcessor(cpu)) {
+            kstd::print("SMP: CPU {} (APIC ID {}) didn't start\n", cpu, mAPICIDs[cpu]);
+            break;
+        }
+    }
+}
+
+/*
+ * Private
+ */
+
+bool
+SMP::startApplicationProcessor(usize cpu)
+{
+    if (!Kernel::systemKernel().memoryManager().initializePerCPU(cpu)) {
+        return false;
+    }
+    Thread* idle = Scheduler::systemScheduler().prepareCPU(cpu);
+    if (!idle) {
+        return false;
+    }
+    // The Thread is at the bottom of its stack; the processor starts at the
+    // top. If it never checks in, the stack stays allocated, in case it shows
+    // up late.
+    auto parameters = reinterpret_cast<TrampolineParameters*>(TrampolineAddress + (apTrampolineParameters - apTrampolineStart));
+    parameters->stack = uptr(idle) + Thread::StackSize;
+    parameters->cpu = cpu;
+    mIsStarted.store(false, kstd::MemoryOrder::Release);
+
+    const auto& localAPIC = x86::InterruptHandler::systemInterruptHandler().localAPIC();
+    const u8 id = mAPICIDs[cpu];
+    localAPIC.sendInterprocessorInterrupt(id, x86::LocalAPIC::DeliveryMode::INIT, 0);
+    delay(InitDelayNanoseconds);
+
+    // A second startup IPI if the first one didn't take.
+    const u8 vector = TrampolineAddress >> 12;
+    for (int i = 0; i < 2; i++) {
+        localAPIC.sendInterprocessorInterrupt(id, x86::LocalAPIC::DeliveryMode::Startup, vector);
+        if (waitFor(mIsStarted, StartupDelayNanoseconds)) {
+            return true;
+        }
+    }
+    return waitFor(mIsStarted, StartTimeoutNanoseconds);
+}
+
+
+void
+SMP::applicationProcessorEntry(usize cpu)
+{
+    // Until this, GS reaches the boot CPU's per-CPU template.
+    x86::loadPerCPUArea(cpu);
+    x86::InterruptHandler::systemInterruptHandler().initializeCPU();
+    FPU::systemFPU().initializeCPU();
+    kstd::RCU::systemRCU().setCPUOnline(cpu, true);
+    Scheduler::systemScheduler().startCPU();
+    Timer::systemTimer().initializeCPU();
+
+    SMP& self = systemSMP();
+    self.mNumberOfCPUs.fetchAdd(1, kstd::MemoryOrder::Relaxed);
+    self.mIsStarted.store(true, kstd::MemoryOrder::Release);
+
+    x86::enableInterrupts();
+    Kernel::systemKernel().idle();
+}
+
+} /* namespace kernel */
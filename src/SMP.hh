@@ -0,0 +1,76 @@
+/* SMP.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Bringing up the application processors.
+ *
+ * The boot CPU is CPU 0. The others are the enabled processors the ACPI MADT
+ * lists, numbered in the order it lists them. Each one is started with an
+ * INIT IPI and up to two startup IPIs, which land it in real mode in the
+ * trampoline in trampoline.S. From there it gets into protected mode on the
+ * kernel GDT, on the stack of its idle thread, loads its per-CPU segment and
+ * the IDT, enables its Local APIC, starts its tick, and settles into the idle
+ * loop.
+ *
+ * Starting the application processors needs the APICs, so a system on the
+ * 8259s runs on the boot CPU alone.
+ */
+
+#ifndef __SMP_HH__
+#define __SMP_HH__
+
+#include "CPU.hh"
+#include "kstd/Atomic.hh"
+#include "kstd/Types.hh"
+
+namespace kernel {
+
+struct SMP
+{
+    static SMP& systemSMP();
+
+    SMP();
+
+    /**
+     * Start every application processor, one at a time. Call on the boot
+     * CPU, with the scheduler and the timer initialized. Processors that
+     * don't come up in time are reported and left alone.
+     */
+    void startApplicationProcessors();
+
+    /** Number of CPUs running, the boot CPU included. */
+    usize numberOfCPUs() const { return mNumberOfCPUs.load(kstd::MemoryOrder::Acquire); }
+
+    /** Bit mask of the CPUs running. They're numbered densely from 0. */
+    u32
+    onlineCPUs()
+        const
+    {
+        const usize count = numberOfCPUs();
+        return count >= x86::MaxCPUs ? ~u32(0) : (1u << count) - 1;
+    }
+
+    /** Local APIC ID of CPU `cpu`. */
+    u8 apicID(usize cpu) const { return mAPICIDs[cpu]; }
+
+private:
+    /** Local APIC IDs, by CPU number. */
+    u8 mAPICIDs[x86::MaxCPUs];
+    kstd::Atomic<usize> mNumberOfCPUs;
+    /** Set by an application processor once it's done starting up. */
+    kstd::Atomic<bool> mIsStarted;
+
+    /** Start CPU `cpu`, and wait for it to check in. */
+    bool startApplicationProcessor(usize cpu);
+
+    /**
+     * Where application processor `cpu` goes from the trampoline, on its idle
+     * thread's stack.
+     */
+    static void applicationProcessorEntry(usize cpu);
+};
+
+} /* namespace kernel */
+
+#endif /* __SMP_HH__ */
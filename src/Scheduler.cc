@@ -0,0 +1,953 @@
+/* Scheduler.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * A preemptive priority scheduler for kernel threads, with an earliest
+ * deadline first class on top.
+ */
+
+#include "Scheduler.hh"
+#include "Clock.hh"
+#include "DeferredWork.hh"
+#include "FPU.hh"
+#include "Kernel.hh"
+#include "SMP.hh"
+#include "Timer.hh"
+#include "kstd/Format.hh"
+#include "kstd/Memory.hh"
+#include "kstd/RCU.hh"
+
+extern "C" {
+    // See switch.S.
+    kernel::Thread* contextSwitch(uptr* saveStackPointer, uptr loadStackPointer, kernel::Thread* previous);
+    void threadTrampoline();
+}
+
+namespace {
+
+static kernel::Scheduler sScheduler;
+
+/** The boot flow of control, on the bootstrap stack from boot.s. */
+static kernel::Thread sBootThread(0, "boot", nullptr, nullptr, kernel::Thread::DefaultPriority);
+
+} /* anonymous namespace */
+
+namespace kernel {
+
+/*
+ * Static
+ */
+
+Scheduler&
+Scheduler::systemScheduler()
+{
+    return sScheduler;
+}
+
+
+u32
+Scheduler::timeSliceForPriority(u32 priority)
+{
+    return MaxTimeSliceTicks - (MaxTimeSliceTicks - MinTimeSliceTicks) * priority / Thread::LowestPriority;
+}
+
+
+bool
+Scheduler::outranks(const Thread& thread,
+                    const Thread& other)
+{
+    if (thread.mClass != other.mClass) {
+        return thread.mClass == Thread::SchedulingClass::Deadline;
+    }
+    if (thread.mClass == Thread::SchedulingClass::Deadline) {
+        return thread.mAbsoluteDeadline < other.mAbsoluteDeadline;
+    }
+    return thread.mPriority < other.mPriority;
+}
+
+
+u32
+Scheduler::utilizationFor(const DeadlineParameters& parameters)
+{
+    // Scale both down together if the multiply would overflow. Rounds up, so
+    // admission errs on the side of saying no.
+    u64 runtime = parameters.runtime;
+    u64 period = parameters.period;
+    while (runtime > ~u64(0) / 1000000) {
+        runtime >>= 1;
+        period >>= 1;
+    }
+    return u32((runtime * 1000000 + period - 1) / period);
+}
+
+
+void
+Scheduler::startPeriod(Thread& thread,
+                       u64 start)
+{
+    thread.mPeriodStart = start;
+    thread.mAbsoluteDeadline = start + thread.mDeadlineParameters.deadline;
+    thread.mRemainingRuntime = thread.mDeadlineParameters.runtime;
+    thread.mIsThrottled = false;
+    thread.mIsMissCounted = false;
+}
+
+/*
+ * Public
+ */
+
+Scheduler::PerCPU::PerCPU()
+    : current(nullptr),
+      idle(nullptr),
+      runQueue(),
+      needsReschedule(false),
+      balanceCountdown(BalanceIntervalTicks),
+      statistics()
+{ }
+
+
+Scheduler::Scheduler()
+    : mInitialized(false),
+      mLock(),
+      mDeadlineQueue(),
+      mCPUs(),
+      mOnlineCPUs(0),
+      mNextID(1),
+      mDeadlineThreads(),
+      mDeadlineUtilization(0),
+      mDeadlineMisses(0),
+      mMissReports(),
+      mMissReportWork(reportDeadlineMisses)
+{ }
+
+
+void
+Scheduler::initialize()
+{
+    PerCPU& cpu = mCPUs[x86::currentCPU()];
+
+    // Nobody joins the boot thread, and its stack is the kernel image's.
+    sBootThread.mState = Thread::State::Running;
+    sBootThread.mOnCPU.store(true, kstd::MemoryOrder::Relaxed);
+    sBootThread.mTimeSlice = timeSliceForPriority(sBootThread.mPriority);
+    sBootThread.mDetached = true;
+    sBootThread.mOwnsStack = false;
+    cpu.current = &sBootThread;
+
+    cpu.idle = create("idle", idleThread, nullptr, Thread::LowestPriority);
+    if (!cpu.idle) {
+        Kernel::systemKernel().panic("Couldn't allocate the idle thread\n");
+    }
+
+    auto& interruptHandler = x86::InterruptHandler::systemInterruptHandler();
+    if (interruptHandler.isUsingAPIC()) {
+        interruptHandler.registerHandler(RescheduleVector, rescheduleInterrupt, nullptr);
+    }
+
+    mOnlineCPUs = 1u << x86::currentCPU();
+    mInitialized = true;
+}
+
+
+Thread*
+Scheduler::prepareCPU(usize cpu)
+{
+    Thread* idle = create("idle", idleThread, nullptr, Thread::LowestPriority);
+    mCPUs[cpu].idle = idle;
+    return idle;
+}
+
+
+void
+Scheduler::startCPU()
+{
+    const usize here = x86::currentCPU();
+    PerCPU& cpu = mCPUs[here];
+    Thread* idle = cpu.idle;
+    idle->mState = Thread::State::Running;
+    idle->mOnCPU.store(true, kstd::MemoryOrder::Relaxed);
+    idle->mCPU = here;
+
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    cpu.current = idle;
+    mOnlineCPUs |= 1u << here;
+}
+
+
+Thread*
+Scheduler::spawn(const char* name,
+                 Thread::Function function,
+                 void* argument,
+                 u32 priority)
+{
+    if (priority > Thread::LowestPriority) {
+        priority = Thread::LowestPriority;
+    }
+    Thread* thread = create(name, function, argument, priority);
+    if (thread) {
+        kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+        enqueue(*thread);
+    }
+    return thread;
+}
+
+
+Thread*
+Scheduler::spawnDeadline(const char* name,
+                         Thread::Function function,
+                         void* argument,
+                         const DeadlineParameters& parameters)
+{
+    if (parameters.runtime == 0 || parameters.runtime > parameters.deadline || parameters.deadline > parameters.period) {
+        return nullptr;
+    }
+
+    // Admission control. Reserve the share up front, so two spawns can't both
+    // squeeze into the last of it.
+    const u32 utilization = utilizationFor(parameters);
+    {
+        kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+        if (mDeadlineUtilization + utilization > MaxDeadlineUtilization) {
+            return nullptr;
+        }
+        mDeadlineUtilization += utilization;
+    }
+
+    Thread* thread = create(name, function, argument, Thread::HighestPriority);
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    if (!thread) {
+        mDeadlineUtilization -= utilization;
+        return nullptr;
+    }
+    thread->mClass = Thread::SchedulingClass::Deadline;
+    thread->mDeadlineParameters = parameters;
+    thread->mBudgetTimer.function = budgetExpired;
+    thread->mReplenishTimer.function = replenish;
+    startPeriod(*thread, Clock::systemClock().nowNanoseconds());
+    mDeadlineThreads.pushBack(*thread);
+    enqueue(*thread);
+    return thread;
+}
+
+
+void
+Scheduler::waitForNextPeriod()
+{
+    kstd::InterruptGuard guard;
+    mLock.lock();
+    Thread* self = current();
+    if (self->mClass != Thread::SchedulingClass::Deadline) {
+        mLock.unlock();
+        return;
+    }
+
+    const u64 now = Clock::systemClock().nowNanoseconds();
+    if (now > self->mAbsoluteDeadline) {
+        countDeadlineMiss(*self, false);
+    }
+
+    const u64 period = self->mDeadlineParameters.period;
+    u64 next = self->mPeriodStart + period;
+    if (next <= now) {
+        // Overran whole periods. Skip to the next one that hasn't started.
+        next += ((now - next) / period + 1) * period;
+    }
+    self->mIsThrottled = true;
+    self->mState = Thread::State::Blocked;
+    Timer::systemTimer().arm(self->mReplenishTimer, next);
+    switchAway();
+}
+
+
+void
+Scheduler::setPriority(Thread& thread,
+                       u32 priority)
+{
+    if (priority > Thread::LowestPriority) {
+        priority = Thread::LowestPriority;
+    }
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    const bool isQueued = thread.mState == Thread::State::Ready && thread.node.isLinked();
+    if (isQueued) {
+        mCPUs[thread.mCPU].runQueue.remove(thread);
+    }
+    thread.mBasePriority = priority;
+    thread.mPriority = priority;
+    if (isQueued) {
+        enqueue(thread);
+    }
+}
+
+
+bool
+Scheduler::setAffinity(Thread& thread,
+                       u32 cpus)
+{
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    if ((cpus & mOnlineCPUs) == 0) {
+        return false;
+    }
+    thread.mAffinity = cpus;
+    if (cpus & (1u << thread.mCPU)) {
+        return true;
+    }
+
+    if (thread.mState == Thread::State::Ready && thread.node.isLinked()) {
+        mCPUs[thread.mCPU].runQueue.remove(thread);
+        enqueue(thread);
+    } else if (thread.mState == Thread::State::Running) {
+        // switchAway() finds it a new CPU.
+        mCPUs[thread.mCPU].needsReschedule = true;
+        if (thread.mCPU != x86::currentCPU()) {
+            kick(thread.mCPU);
+        }
+    }
+    return true;
+}
+
+
+void
+Scheduler::yield()
+{
+    kstd::InterruptGuard guard;
+    mLock.lock();
+    switchAway();
+}
+
+
+void
+Scheduler::exit()
+{
+    x86::disableInterrupts();
+    mLock.lock();
+    current()->mState = Thread::State::Exiting;
+    switchAway();
+    Kernel::systemKernel().panic("Thread came back from exit()\n");
+}
+
+
+void
+Scheduler::join(Thread& thread)
+{
+    {
+        kstd::InterruptGuard guard;
+        mLock.lock();
+        while (thread.mState != Thread::State::Exited) {
+            Thread* self = current();
+            thread.mJoiner = self;
+            self->mState = Thread::State::Blocked;
+            switchAway();
+            mLock.lock();
+        }
+        mLock.unlock();
+    }
+    free(thread);
+}
+
+
+void
+Scheduler::detach(Thread& thread)
+{
+    bool hasExited;
+    {
+        kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+        hasExited = thread.mState == Thread::State::Exited;
+        thread.mDetached = true;
+    }
+    if (hasExited) {
+        free(thread);
+    }
+}
+
+
+void
+Scheduler::block(kstd::SpinLock& lock)
+{
+    mLock.lock();
+    current()->mState = Thread::State::Blocked;
+    lock.unlock();
+    switchAway();
+}
+
+
+void
+Scheduler::wake(Thread& thread)
+{
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    makeReady(thread);
+}
+
+
+bool
+Scheduler::hasReadyThreads()
+{
+    const usize here = x86::currentCPU();
+    if (!mCPUs[here].runQueue.isEmpty() || !mDeadlineQueue.isEmpty()) {
+        return true;
+    }
+    if (mOnlineCPUs == (1u << here)) {
+        return false;
+    }
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    usize from;
+    return findStealable(here, from) != nullptr;
+}
+
+
+usize
+Scheduler::readyThreads()
+    const
+{
+    usize count = mDeadlineQueue.size();
+    for (const PerCPU& cpu : mCPUs) {
+        count += cpu.runQueue.size();
+    }
+    return count;
+}
+
+
+void
+Scheduler::tick()
+{
+    if (!mInitialized) {
+        return;
+    }
+    const usize here = x86::currentCPU();
+    PerCPU& cpu = mCPUs[here];
+    if (--cpu.balanceCountdown == 0) {
+        cpu.balanceCountdown = BalanceIntervalTicks;
+        balance(here);
+    }
+
+    Thread* thread = cpu.current;
+    // Deadline threads run until their runtime's up, which the budget timer
+    // takes care of.
+    if (thread == cpu.idle || thread->mClass == Thread::SchedulingClass::Deadline) {
+        return;
+    }
+    if (thread->mTimeSlice == 0 || --thread->mTimeSlice > 0) {
+        return;
+    }
+
+    // Used up a whole slice: lose a level of boost.
+    kstd::LockGuard<kstd::SpinLock> guard(mLock);
+    if (thread->mPriority < thread->mBasePriority) {
+        thread->mPriority++;
+    }
+    cpu.needsReschedule = true;
+}
+
+
+void
+Scheduler::preemptIfNeeded()
+{
+    if (!mInitialized) {
+        return;
+    }
+    PerCPU& cpu = mCPUs[x86::currentCPU()];
+    // The idle thread yields on its own once it's caught up with the tick.
+    if (!cpu.needsReschedule || cpu.current == cpu.idle) {
+        return;
+    }
+    // Deferred work and RCU readers further up the stack have to finish first.
+    if (DeferredWork::systemDeferredWork().isRunning() || kstd::RCU::systemRCU().isInReadSection()) {
+        return;
+    }
+    mLock.lock();
+    switchAway();
+}
+
+
+void
+Scheduler::startThread(Thread* previous)
+{
+    finishSwitch(previous);
+    x86::enableInterrupts();
+
+    Thread* self = current();
+    self->mFunction(self->mArgument);
+    exit();
+}
+
+/*
+ * Private
+ */
+
+Thread*
+Scheduler::create(const char* name,
+                  Thread::Function function,
+                  void* argument,
+                  u32 priority)
+{
+    void* memory = Kernel::systemKernel().memoryManager().frameAllocator().allocateContiguous(Thread::StackPages);
+    if (!memory) {
+        return nullptr;
+    }
+    Thread* thread = new (memory) Thread(mNextID.fetchAdd(1, kstd::MemoryOrder::Relaxed), name, function, argument, priority);
+    thread->mCPU = x86::currentCPU();
+
+    // Lay out the stack so the first switch to the thread returns into
+    // threadTrampoline. Three words of padding keep the stack 16 byte aligned
+    // at its call to threadStart().
+    u32* stack = reinterpret_cast<u32*>(uptr(memory) + Thread::StackSize);
+    *--stack = 0;
+    *--stack = 0;
+    *--stack = 0;
+    *--stack = u32(threadTrampoline);
+    *--stack = 0;       // ebp
+    *--stack = 0;       // ebx
+    *--stack = 0;       // esi
+    *--stack = 0;       // edi
+    thread->mStackPointer = uptr(stack);
+    return thread;
+}
+
+
+void
+Scheduler::free(Thread& thread)
+{
+    if (thread.mOwnsStack) {
+        Kernel::systemKernel().memoryManager().frameAllocator().free(&thread, Thread::StackPages);
+    }
+}
+
+
+void
+Scheduler::makeReady(Thread& thread)
+{
+    if (thread.mState != Thread::State::Blocked) {
+        return;
+    }
+    thread.mState = Thread::State::Ready;
+
+    // Blocked before its slice ran out: move up a level.
+    const u32 ceiling = thread.mBasePriority > MaxInteractiveBoost ? thread.mBasePriority - MaxInteractiveBoost : Thread::HighestPriority;
+    if (thread.mClass == Thread::SchedulingClass::Normal && thread.mPriority > ceiling) {
+        thread.mPriority--;
+    }
+    enqueue(thread);
+}
+
+
+void
+Scheduler::enqueue(Thread& thread)
+{
+    const usize here = x86::currentCPU();
+    usize target = here;
+    if (thread.mClass == Thread::SchedulingClass::Normal) {
+        target = selectCPU(thread, here);
+        if (target != thread.mCPU) {
+            // Threads that haven't run yet have no cache to leave behind.
+            if (thread.mLastRan != 0) {
+                mCPUs[target].statistics.migrations++;
+            }
+            thread.mCPU = target;
+        }
+    } else {
+        // Deadline threads share one queue, so this only says who to poke.
+        target = selectDeadlineCPU(thread, here);
+    }
+    pushReady(thread);
+
+    PerCPU& cpu = mCPUs[target];
+    if (!cpu.current) {
+        return;
+    }
+    if (target == here) {
+        // The idle thread notices by itself.
+        if (cpu.current != cpu.idle && outranks(thread, *cpu.current)) {
+            cpu.needsReschedule = true;
+        }
+    } else if (cpu.current == cpu.idle) {
+        kick(target);
+    } else if (outranks(thread, *cpu.current)) {
+        cpu.needsReschedule = true;
+        kick(target);
+    }
+}
+
+
+void
+Scheduler::pushReady(Thread& thread)
+{
+    if (thread.mClass == Thread::SchedulingClass::Deadline) {
+        mDeadlineQueue.insert(thread);
+    } else {
+        mCPUs[thread.mCPU].runQueue.pushBack(thread);
+    }
+}
+
+
+bool
+Scheduler::isIdle(usize cpu)
+    const
+{
+    const PerCPU& state = mCPUs[cpu];
+    return state.current == state.idle && state.runQueue.isEmpty();
+}
+
+
+usize
+Scheduler::selectCPU(const Thread& thread,
+                     usize here)
+    const
+{
+    const u32 allowed = thread.mAffinity & mOnlineCPUs;
+    if (allowed == 0) {
+        // Nothing's online yet.
+        return here;
+    }
+    const usize last = thread.mCPU;
+    const bool canStay = (allowed & (1u << last)) != 0;
+    if (canStay && isIdle(last)) {
+        return last;
+    }
+    for (u32 cpus = allowed; cpus != 0; cpus &= cpus - 1) {
+        const usize cpu = x86::bitScanForward(cpus);
+        if (isIdle(cpu)) {
+            return cpu;
+        }
+    }
+    // Everyone's busy. Balancing evens it out later.
+    if (canStay) {
+        return last;
+    }
+    if (allowed & (1u << here)) {
+        return here;
+    }
+    return x86::bitScanForward(allowed);
+}
+
+
+usize
+Scheduler::selectDeadlineCPU(const Thread& thread,
+                             usize here)
+    const
+{
+    const PerCPU& local = mCPUs[here];
+    if (!local.current || local.current == local.idle || outranks(thread, *local.current)) {
+        return here;
+    }
+    usize weakest = here;
+    for (u32 cpus = mOnlineCPUs & ~(1u << here); cpus != 0; cpus &= cpus - 1) {
+        const usize cpu = x86::bitScanForward(cpus);
+        const PerCPU& peer = mCPUs[cpu];
+        if (!peer.current) {
+            continue;
+        }
+        if (peer.current == peer.idle) {
+            return cpu;
+        }
+        if (weakest == here || outranks(*mCPUs[weakest].current, *peer.current)) {
+            weakest = cpu;
+        }
+    }
+    if (weakest != here && outranks(thread, *mCPUs[weakest].current)) {
+        return weakest;
+    }
+    // Everyone's running something more urgent. Whoever finishes first takes it.
+    return here;
+}
+
+
+Thread*
+Scheduler::findStealable(usize here,
+                         usize& from)
+    const
+{
+    const u32 bit = 1u << here;
+    u32 untried = mOnlineCPUs & ~bit;
+    while (untried != 0) {
+        usize busiest = here;
+        usize most = 0;
+        for (u32 cpus = untried; cpus != 0; cpus &= cpus - 1) {
+            const usize cpu = x86::bitScanForward(cpus);
+            if (mCPUs[cpu].runQueue.size() > most) {
+                busiest = cpu;
+                most = mCPUs[cpu].runQueue.size();
+            }
+        }
+        if (busiest == here) {
+            return nullptr;
+        }
+        Thread* thread = mCPUs[busiest].runQueue.findLast([bit](const Thread& candidate) {
+            return (candidate.mAffinity & bit) != 0;
+        });
+        if (thread) {
+            from = busiest;
+            return thread;
+        }
+        untried &= ~(1u << busiest);
+    }
+    return nullptr;
+}
+
+
+void
+Scheduler::migrate(Thread& thread,
+                   usize from,
+                   usize to)
+{
+    mCPUs[from].runQueue.remove(thread);
+    thread.mCPU = to;
+    mCPUs[to].runQueue.pushBack(thread);
+    mCPUs[to].statistics.migrations++;
+}
+
+
+void
+Scheduler::balance(usize here)
+{
+    kstd::LockGuard<kstd::SpinLock> guard(mLock);
+    PerCPU& cpu = mCPUs[here];
+
+    // Moving one thread has to leave us no busier than the peer, or the two
+    // would pass it back and forth.
+    usize busiest = here;
+    usize most = cpu.runQueue.size() + 1;
+    for (u32 cpus = mOnlineCPUs & ~(1u << here); cpus != 0; cpus &= cpus - 1) {
+        const usize peer = x86::bitScanForward(cpus);
+        if (mCPUs[peer].runQueue.size() > most) {
+            busiest = peer;
+            most = mCPUs[peer].runQueue.size();
+        }
+    }
+    if (busiest == here) {
+        return;
+    }
+
+    const u32 bit = 1u << here;
+    const u64 now = Clock::systemClock().nowNanoseconds();
+    Thread* thread = mCPUs[busiest].runQueue.findLast([bit, now](const Thread& candidate) {
+        return (candidate.mAffinity & bit) != 0 && now - candidate.mLastRan >= MigrationCostNanoseconds;
+    });
+    if (!thread) {
+        return;
+    }
+    migrate(*thread, busiest, here);
+    if (cpu.current == cpu.idle || outranks(*thread, *cpu.current)) {
+        cpu.needsReschedule = true;
+    }
+}
+
+
+void
+Scheduler::kick(usize cpu)
+{
+    const auto& localAPIC = x86::InterruptHandler::systemInterruptHandler().localAPIC();
+    localAPIC.sendInterprocessorInterrupt(SMP::systemSMP().apicID(cpu), x86::LocalAPIC::DeliveryMode::Fixed, RescheduleVector);
+}
+
+
+void
+Scheduler::chargeRuntime(Thread& thread,
+                         u64 now)
+{
+    const u64 ran = now - thread.mRunStart;
+    thread.mRemainingRuntime = ran < thread.mRemainingRuntime ? thread.mRemainingRuntime - ran : 0;
+    thread.mRunStart = now;
+}
+
+
+void
+Scheduler::countDeadlineMiss(Thread& thread,
+                             bool wasThrottled)
+{
+    if (thread.mIsMissCounted) {
+        return;
+    }
+    thread.mIsMissCounted = true;
+    thread.mDeadlineMisses++;
+    mDeadlineMisses.fetchAdd(1, kstd::MemoryOrder::Relaxed);
+
+    // This can be in the timer interrupt. Print it later.
+    const DeadlineMiss miss = { thread.mID, thread.mName, thread.mDeadlineMisses, wasThrottled };
+    mMissReports.push(miss);
+    DeferredWork::systemDeferredWork().schedule(mMissReportWork);
+}
+
+
+void
+Scheduler::switchAway()
+{
+    const usize here = x86::currentCPU();
+    PerCPU& cpu = mCPUs[here];
+    Thread* previous = cpu.current;
+    if (!previous->isStackIntact()) {
+        mLock.unlock();
+        Kernel::systemKernel().panic("Thread %d (%s) overflowed its stack\n", previous->mID, previous->mName);
+    }
+
+    cpu.needsReschedule = false;
+    auto& timer = Timer::systemTimer();
+    const u64 now = Clock::systemClock().nowNanoseconds();
+    previous->mLastRan = now;
+    if (previous->mClass == Thread::SchedulingClass::Deadline) {
+        timer.cancel(previous->mBudgetTimer);
+        chargeRuntime(*previous, now);
+    }
+
+    if (previous->mState == Thread::State::Running) {
+        if (previous->mIsThrottled) {
+            // Out of runtime. Sit out the rest of the period.
+            previous->mState = Thread::State::Blocked;
+            timer.arm(previous->mReplenishTimer, previous->mPeriodStart + previous->mDeadlineParameters.period);
+        } else {
+            previous->mState = Thread::State::Ready;
+            if (previous == cpu.idle) {
+                // Never queued.
+            } else if (previous->mClass == Thread::SchedulingClass::Normal && (previous->mAffinity & (1u << here)) == 0) {
+                // Its affinity changed while it ran.
+                enqueue(*previous);
+            } else {
+                pushReady(*previous);
+            }
+        }
+    }
+
+    Thread* next = mDeadlineQueue.popFirst();
+    if (!next) {
+        next = cpu.runQueue.popFront();
+    }
+    if (!next) {
+        // Nothing of our own. Help out a busier CPU before going idle.
+        usize from;
+        next = findStealable(here, from);
+        if (next) {
+            mCPUs[from].runQueue.remove(*next);
+            cpu.statistics.steals++;
+            cpu.statistics.migrations++;
+        }
+    }
+    if (!next) {
+        next = cpu.idle;
+    }
+    next->mState = Thread::State::Running;
+    next->mCPU = here;
+    if (next->mClass == Thread::SchedulingClass::Deadline) {
+        next->mRunStart = now;
+        timer.arm(next->mBudgetTimer, now + next->mRemainingRuntime);
+    } else {
+        next->mTimeSlice = timeSliceForPriority(next->mPriority);
+    }
+    cpu.current = next;
+    mLock.unlock();
+
+    if (next == previous) {
+        return;
+    }
+
+    // Another CPU may have switched away from `next` a moment ago, and still
+    // be on its stack.
+    while (next->mOnCPU.load(kstd::MemoryOrder::Acquire)) {
+        x86::pause();
+    }
+    next->mOnCPU.store(true, kstd::MemoryOrder::Relaxed);
+
+    FPU::systemFPU().switchThreads(*previous, *next);
+    previous = contextSwitch(&previous->mStackPointer, next->mStackPointer, previous);
+    finishSwitch(previous);
+}
+
+
+void
+Scheduler::finishSwitch(Thread* previous)
+{
+    previous->mOnCPU.store(false, kstd::MemoryOrder::Release);
+
+    // The exiting thread can't free its own stack. Now that we're off it, it
+    // can go.
+    if (previous->mState == Thread::State::Exiting) {
+        bool shouldFree;
+        {
+            kstd::LockGuard<kstd::SpinLock> guard(mLock);
+            previous->mState = Thread::State::Exited;
+            if (previous->mClass == Thread::SchedulingClass::Deadline) {
+                mDeadlineUtilization -= utilizationFor(previous->mDeadlineParameters);
+                mDeadlineThreads.remove(*previous);
+            }
+            if (previous->mJoiner) {
+                makeReady(*previous->mJoiner);
+            }
+            shouldFree = previous->mDetached;
+        }
+        if (shouldFree) {
+            free(*previous);
+        }
+    }
+
+    kstd::RCU::systemRCU().quiescentState();
+}
+
+
+void
+Scheduler::idleThread(void*)
+{
+    Kernel::systemKernel().idle();
+}
+
+
+bool
+Scheduler::rescheduleInterrupt(const x86::InterruptFrame&,
+                               void*)
+{
+    // Nothing to do here. The way out of the interrupt preempts the running
+    // thread if it has to, and an idle CPU wakes up and looks around.
+    return true;
+}
+
+
+void
+Scheduler::budgetExpired(HighResolutionTimer& timer)
+{
+    Thread& thread = *kstd::containerOf<Thread, HighResolutionTimer, &Thread::mBudgetTimer>(&timer);
+    Scheduler& self = systemScheduler();
+    kstd::LockGuard<kstd::SpinLock> guard(self.mLock);
+    PerCPU& cpu = self.mCPUs[x86::currentCPU()];
+    if (cpu.current != &thread) {
+        // Switched out while this was firing.
+        return;
+    }
+    // It can't get any more CPU until its next period, which starts no
+    // earlier than its deadline.
+    thread.mIsThrottled = true;
+    self.countDeadlineMiss(thread, true);
+    cpu.needsReschedule = true;
+}
+
+
+void
+Scheduler::replenish(HighResolutionTimer& timer)
+{
+    Thread& thread = *kstd::containerOf<Thread, HighResolutionTimer, &Thread::mReplenishTimer>(&timer);
+    Scheduler& self = systemScheduler();
+    kstd::LockGuard<kstd::SpinLock> guard(self.mLock);
+    const bool wasWaiting = thread.mIsThrottled;
+    startPeriod(thread, timer.expires);
+    if (wasWaiting && thread.mState == Thread::State::Blocked) {
+        thread.mState = Thread::State::Ready;
+        self.enqueue(thread);
+    }
+}
+
+
+void
+Scheduler::reportDeadlineMisses(WorkItem&)
+{
+    DeadlineMiss miss;
+    while (systemScheduler().mMissReports.pop(miss)) {
+        kstd::print("Deadline miss: thread {} ({}) {}, {} so far\n", miss.thread, miss.name,
+                    miss.wasThrottled ? "ran out of runtime" : "finished late", miss.misses);
+    }
+}
+
+} /* namespace kernel */
+
+/** Called by threadTrampoline in switch.S. */
+extern "C"
+void
+threadStart(kernel::Thread* previous)
+{
+    kernel::Scheduler::systemScheduler().startThread(previous);
+}
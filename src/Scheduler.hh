@@ -0,0 +1,345 @@
+/* Scheduler.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * A preemptive priority scheduler for kernel threads.
+ *
+ * Ready threads wait in a RunQueue, which has a FIFO for each of the 32
+ * priority levels. The CPU always goes to the first thread at the highest
+ * priority level; threads at the same level take turns round-robin. A thread
+ * runs until it yields, blocks, exits, uses up its time slice, or a higher
+ * priority thread becomes ready. When the queue is empty the CPU runs its idle
+ * thread, which is never on the queue.
+ *
+ * Each CPU has its own run queue. A thread that wakes goes back to the CPU it
+ * last ran on if that CPU is idle, since its cache may still be warm there;
+ * otherwise to any idle CPU, and failing that it stays put. A CPU that runs
+ * out of threads steals one from the busiest peer before going idle, taking
+ * the one that would have waited longest there. Every BalanceIntervalTicks,
+ * each ticking CPU also pulls a thread from the busiest peer if that peer has
+ * at least two more waiting, leaving alone threads that ran in the last
+ * MigrationCostNanoseconds. Threads only ever run on CPUs in their affinity
+ * mask. Idle CPUs are woken with a reschedule IPI when work arrives for them.
+ *
+ * Higher priority threads get longer time slices, from MaxTimeSliceTicks at
+ * the highest level down to MinTimeSliceTicks at the lowest. Threads that
+ * block before using up their slice -- interactive ones, and threads handling
+ * interrupts -- move up a level each time they wake, to at most
+ * MaxInteractiveBoost levels above their base priority, and back down a level
+ * each slice they use up.
+ *
+ * Threads in the deadline class run ahead of all of that, earliest absolute
+ * deadline first. Each has a reservation of some runtime every period (see
+ * DeadlineParameters), and admission control turns away a new one if the
+ * reservations would add up to more than MaxDeadlineUtilization of a CPU. A
+ * high resolution timer enforces the runtime: a thread that uses it up is
+ * throttled until its next period. A deadline thread does a period's work,
+ * then calls waitForNextPeriod(). Finishing a period's work after its
+ * deadline, or being throttled before finishing it, counts as a deadline
+ * miss; misses are reported on the console. There's one deadline queue for
+ * every CPU, and deadline threads don't have affinity.
+ *
+ * Preemption happens on the way out of a hardware interrupt, after the EOI and
+ * deferred work, so a thread never gets switched out with an interrupt in
+ * service. Every context switch is a quiescent state for RCU.
+ */
+
+#ifndef __SCHEDULER_HH__
+#define __SCHEDULER_HH__
+
+#include "Attributes.hh"
+#include "CPU.hh"
+#include "RunQueue.hh"
+#include "Thread.hh"
+#include "kstd/Atomic.hh"
+#include "kstd/List.hh"
+#include "kstd/RedBlackTree.hh"
+#include "kstd/RingBuffer.hh"
+#include "kstd/SpinLock.hh"
+#include "kstd/Types.hh"
+
+namespace kernel {
+
+struct Scheduler
+{
+    /** @{ Time slice lengths, in ticks, at the lowest and highest priority. */
+    static const u32 MinTimeSliceTicks = 2;
+    static const u32 MaxTimeSliceTicks = 20;
+    /** @} */
+
+    /** Most levels a thread's effective priority can be boosted above its base priority. */
+    static const u32 MaxInteractiveBoost = 4;
+
+    /** Time slice for a thread at `priority`. */
+    static u32 timeSliceForPriority(u32 priority);
+
+    /** @{ Load balancing. See above. */
+    static const u32 BalanceIntervalTicks = 4;
+    static const u64 MigrationCostNanoseconds = 500000;
+    /** @} */
+
+    /** Vector of the IPI that gets a CPU to look at its run queue. */
+    static const u8 RescheduleVector = 0xEE;
+
+    /** Load balancing counters for a CPU. */
+    struct Statistics
+    {
+        /** Threads this CPU took from a peer because it had nothing else to run. */
+        u32 steals;
+        /** Threads moved to this CPU from another one: stolen, pulled by balancing, or woken here. */
+        u32 migrations;
+    };
+
+    /** Most of a CPU deadline threads can reserve between them, in parts per million. */
+    static const u32 MaxDeadlineUtilization = 900000;
+
+    static Scheduler& systemScheduler();
+
+    Scheduler();
+
+    /**
+     * Adopt the boot flow of control as the first thread, and create this
+     * CPU's idle thread. Needs the frame allocator.
+     */
+    void initialize();
+
+    bool isInitialized() const { return mInitialized; }
+
+    /**
+     * Create the idle thread for application processor `cpu`, on the boot
+     * CPU. The processor starts out on the idle thread's stack, and calls
+     * startCPU() from there.
+     *
+     * @return The idle thread, or null if there wasn't memory for its stack.
+     */
+    Thread* prepareCPU(usize cpu);
+
+    /** Adopt the calling flow of control, on an application processor, as its idle thread. */
+    void startCPU();
+
+    /**
+     * Create a thread that calls `function(argument)` at `priority`, and put it
+     * on the run queue. If `function` returns, the thread exits.
+     *
+     * @return The new thread, or null if there wasn't memory for its stack.
+     *         Someone has to join() or detach() it.
+     */
+    Thread* spawn(const char* name, Thread::Function function, void* argument, u32 priority = Thread::DefaultPriority);
+
+    /**
+     * Create a thread in the deadline class with the reservation in
+     * `parameters`. Its first period starts right away.
+     *
+     * @return The new thread, or null if the parameters don't make sense, the
+     *         reservation doesn't fit, or there wasn't memory for its stack.
+     */
+    Thread* spawnDeadline(const char* name, Thread::Function function, void* argument, const DeadlineParameters& parameters);
+
+    /**
+     * Called by a deadline thread when it's done with this period's work.
+     * Blocks until the next period starts, with a fresh runtime and deadline.
+     */
+    void waitForNextPeriod();
+
+    /** Share of a CPU reserved by deadline threads, in parts per million. */
+    u32 deadlineUtilization() const { return mDeadlineUtilization; }
+
+    /** Total deadline misses, across every deadline thread there's been. */
+    u32 deadlineMisses() const { return mDeadlineMisses.load(kstd::MemoryOrder::Relaxed); }
+
+    /** Change the base priority of `thread`. Its effective priority starts over from there. */
+    void setPriority(Thread& thread, u32 priority);
+
+    /**
+     * Only run `thread` on the CPUs in `cpus`, a mask with bit n for CPU n. A
+     * thread that's running somewhere else moves the next time it's
+     * preempted; a thread moving itself can yield() to go right away.
+     *
+     * @return `false` if none of those CPUs are running.
+     */
+    bool setAffinity(Thread& thread, u32 cpus);
+
+    Statistics statistics(usize cpu) const { return mCPUs[cpu].statistics; }
+
+    /** The thread running on this CPU. */
+    Thread* current() const { return mCPUs[x86::currentCPU()].current; }
+
+    /** Give up the CPU to the next ready thread, if there is one. */
+    void yield();
+
+    /** End the calling thread. */
+    void exit() NORETURN;
+
+    /**
+     * Wait for `thread` to exit, then free it. Only one thread may join a
+     * given thread, and not after detaching it.
+     */
+    void join(Thread& thread);
+
+    /** Free `thread` as soon as it exits, without anyone joining it. */
+    void detach(Thread& thread);
+
+    /**
+     * Block the calling thread until someone wake()s it, releasing `lock`
+     * once it's marked blocked. Call with interrupts disabled and `lock` held;
+     * returns with interrupts still disabled and `lock` released. A waker that
+     * takes `lock` can't miss the thread. This is what WaitQueue is built on.
+     */
+    void block(kstd::SpinLock& lock);
+
+    /**
+     * Make a blocked thread ready again. Does nothing if it isn't blocked. If
+     * it outranks the running thread, that one is preempted on the way out of
+     * the next interrupt. Safe to call from interrupt handlers. A thread
+     * asleep on a WaitQueue has to be woken through the queue.
+     */
+    void wake(Thread& thread);
+
+    /** `true` if there's a thread this CPU could run: its own, or one it could steal. */
+    bool hasReadyThreads();
+
+    /** Number of threads waiting on the run queues, across every CPU. */
+    usize readyThreads() const;
+
+    /** Count down the running thread's time slice. Called from the timer tick. */
+    void tick();
+
+    /**
+     * Switch threads if the running one's time slice or runtime is up, or a
+     * thread that outranks it is ready. Called with interrupts disabled on the
+     * way out of an interrupt.
+     */
+    void preemptIfNeeded();
+
+    /**
+     * Where a new thread starts, on its own stack, right after the switch to
+     * it from `previous`. Only for threadStart() in switch.S.
+     */
+    void startThread(Thread* previous) NORETURN;
+
+private:
+    struct DeadlineTraits
+    {
+        typedef u64 Key;
+        static Key key(const Thread& thread) { return thread.mAbsoluteDeadline; }
+    };
+
+    typedef kstd::RedBlackTree<Thread, &Thread::deadlineNode, DeadlineTraits> DeadlineQueue;
+    typedef kstd::List<Thread, &Thread::mDeadlineThreadsNode> DeadlineThreadList;
+
+    struct DeadlineMiss
+    {
+        u32 thread;
+        const char* name;
+        u32 misses;
+        /** `true` if it ran out of runtime, rather than finishing late. */
+        bool wasThrottled;
+    };
+
+    struct PerCPU
+    {
+        PerCPU();
+
+        Thread* current;
+        Thread* idle;
+        /** Ready Normal threads waiting for this CPU. */
+        RunQueue runQueue;
+        /** Set when the running thread should give up the CPU. */
+        bool needsReschedule;
+        /** Ticks until the next periodic balance. */
+        u32 balanceCountdown;
+        Statistics statistics;
+    };
+
+    bool mInitialized;
+    /** Protects the run queues and every thread's scheduling state. */
+    kstd::SpinLock mLock;
+    /** Ready deadline threads, by absolute deadline. */
+    DeadlineQueue mDeadlineQueue;
+    PerCPU mCPUs[x86::MaxCPUs];
+    /** CPUs that have started scheduling, as a mask. */
+    u32 mOnlineCPUs;
+    kstd::Atomic<u32> mNextID;
+
+    /** Every deadline thread, for admission control and reporting misses. */
+    DeadlineThreadList mDeadlineThreads;
+    u32 mDeadlineUtilization;
+    kstd::Atomic<u32> mDeadlineMisses;
+    /** Misses waiting to be reported. Pushed from interrupt context. */
+    kstd::MultiProducerRingBuffer<DeadlineMiss, 16> mMissReports;
+    WorkItem mMissReportWork;
+
+    Thread* create(const char* name, Thread::Function function, void* argument, u32 priority);
+    void free(Thread& thread);
+    /** Put a blocked thread on the run queue, with a boost. Call with mLock held. */
+    void makeReady(Thread& thread);
+    /**
+     * Pick a CPU for a thread that's ready, put it on that CPU's run queue,
+     * and ask for a reschedule if it outranks the thread running there. Call
+     * with mLock held.
+     */
+    void enqueue(Thread& thread);
+    /** Put a ready thread on its CPU's run queue. Call with mLock held. */
+    void pushReady(Thread& thread);
+    /** `true` if `thread` should run before `other`. */
+    static bool outranks(const Thread& thread, const Thread& other);
+
+    /**
+     * @defgroup Load Balancing
+     * All of these need mLock held.
+     * @{
+     */
+    /** `true` if `cpu` is running its idle thread with nothing queued. */
+    bool isIdle(usize cpu) const;
+    /** Where a thread that's become ready should go. `here` is the calling CPU. */
+    usize selectCPU(const Thread& thread, usize here) const;
+    /**
+     * Which CPU to tell about a deadline thread that's become ready: `here`
+     * if it'll run the thread next, otherwise an idle peer, or the peer running
+     * the lowest ranked thread if the new one outranks it.
+     */
+    usize selectDeadlineCPU(const Thread& thread, usize here) const;
+    /**
+     * A thread `here` could take from the busiest peer that has one, or null.
+     * Sets `from` to the peer.
+     */
+    Thread* findStealable(usize here, usize& from) const;
+    /** Move a ready thread from `from`'s run queue to `to`'s. */
+    void migrate(Thread& thread, usize from, usize to);
+    /** Pull a thread from the busiest peer if it has at least two more waiting than `here`. */
+    void balance(usize here);
+    /** Send `cpu` a reschedule IPI. */
+    void kick(usize cpu);
+    /** @} */
+
+    /** Share of a CPU `parameters` reserves, in parts per million. */
+    static u32 utilizationFor(const DeadlineParameters& parameters);
+    /** Charge a deadline thread for the time it's run since mRunStart. Call with mLock held. */
+    void chargeRuntime(Thread& thread, u64 now);
+    /** Count a deadline miss for this period, if it hasn't been already. Call with mLock held. */
+    void countDeadlineMiss(Thread& thread, bool wasThrottled);
+    /** Start `thread`'s period at `start`, with a fresh runtime and deadline. */
+    static void startPeriod(Thread& thread, u64 start);
+
+    /**
+     * Switch away from the running thread, to the next ready thread or the
+     * idle thread. Call with interrupts disabled and mLock held; mLock is
+     * released before the switch. If the running thread is still Running, it
+     * goes to the back of the run queue.
+     */
+    void switchAway();
+
+    /** Finish a switch away from `previous`, on the new thread's stack. */
+    void finishSwitch(Thread* previous);
+
+    static void idleThread(void* argument);
+    static bool rescheduleInterrupt(const x86::InterruptFrame& frame, void* context);
+    static void budgetExpired(HighResolutionTimer& timer);
+    static void replenish(HighResolutionTimer& timer);
+    static void reportDeadlineMisses(WorkItem& item);
+};
+
+} /* namespace kernel */
+
+#endif /* __SCHEDULER_HH__ */
@@ -0,0 +1,235 @@
+/* Thread.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Kernel threads.
+ */
+
+#ifndef __THREAD_HH__
+#define __THREAD_HH__
+
+#include "FPU.hh"
+#include "Timer.hh"
+#include "kstd/Atomic.hh"
+#include "kstd/List.hh"
+#include "kstd/RedBlackTree.hh"
+#include "kstd/Types.hh"
+
+namespace kernel {
+
+/**
+ * Reservation for a thread in the deadline scheduling class, in nanoseconds:
+ * every `period`, the thread gets `runtime` of CPU time, to be used within
+ * `deadline` of the start of the period. runtime <= deadline <= period.
+ */
+struct DeadlineParameters
+{
+    u64 runtime;
+    u64 deadline;
+    u64 period;
+};
+
+
+/**
+ * A kernel thread. Each one has a stack of StackPages page frames, and the
+ * Thread itself lives at the bottom of it, below where the stack can grow
+ * to. Threads are created and switched between by the Scheduler.
+ */
+struct Thread
+{
+    typedef void (*Function)(void* argument);
+
+    enum class SchedulingClass {
+        /** Scheduled by priority, round-robin within a priority level. */
+        Normal,
+        /** Scheduled earliest deadline first, ahead of every Normal thread. */
+        Deadline,
+    };
+
+    enum class State {
+        /** On the run queue, waiting for a CPU. */
+        Ready,
+        Running,
+        /** Waiting for something; someone has to wake() it. */
+        Blocked,
+        /** Called exit(), but still on its stack. */
+        Exiting,
+        /** Off its stack for good. Its frames can be freed. */
+        Exited,
+    };
+
+    /**
+     * @defgroup Priority
+     * Lower numbers run first. Each thread has a base priority, set when it's
+     * created, and an effective priority the scheduler moves around: up a
+     * level each time it wakes from blocking, and back down a level each time
+     * it uses up a time slice.
+     * @{
+     */
+    static const u32 PriorityLevels = 32;
+    static const u32 HighestPriority = 0;
+    static const u32 DefaultPriority = 16;
+    static const u32 LowestPriority = PriorityLevels - 1;
+    /** @} */
+
+    /** Affinity mask that allows every CPU. */
+    static const u32 AnyCPU = ~u32(0);
+
+    /** No CPU, for mFPUCPU. */
+    static const u16 NoCPU = 0xFFFF;
+
+    static const usize StackPages = 4;
+    static const usize StackSize = StackPages * 0x1000;
+
+    /** Written at the top of the Thread. A stack overflow tramples it first. */
+    static const u32 StackCanary = 0x57AC4CA7;
+
+    Thread(u32 id,
+           const char* name,
+           Function function,
+           void* argument,
+           u32 priority)
+        : node(),
+          deadlineNode(),
+          mID(id),
+          mName(name),
+          mState(State::Ready),
+          mBasePriority(priority),
+          mPriority(priority),
+          mFunction(function),
+          mArgument(argument),
+          mClass(SchedulingClass::Normal),
+          mDeadlineParameters(),
+          mPeriodStart(0),
+          mAbsoluteDeadline(0),
+          mRemainingRuntime(0),
+          mRunStart(0),
+          mDeadlineMisses(0),
+          mIsThrottled(false),
+          mIsMissCounted(false),
+          mBudgetTimer(nullptr),
+          mReplenishTimer(nullptr),
+          mDeadlineThreadsNode(),
+          mStackPointer(0),
+          mOnCPU(false),
+          mCPU(0),
+          mAffinity(AnyCPU),
+          mLastRan(0),
+          mTimeSlice(0),
+          mDetached(false),
+          mOwnsStack(true),
+          mJoiner(nullptr),
+          mFPUState(),
+          mHasFPUState(false),
+          mIsFPUEager(false),
+          mFPUCPU(NoCPU),
+          mStackCanary(StackCanary)
+    { }
+
+    /** `true` if the canary is intact. */
+    bool isStackIntact() const { return mStackCanary == StackCanary; }
+
+    u32 id() const { return mID; }
+    const char* name() const { return mName; }
+    State state() const { return mState; }
+    u32 basePriority() const { return mBasePriority; }
+    /** Effective priority, which the run queue goes by. */
+    u32 priority() const { return mPriority; }
+
+    /** CPU the thread is running on, or queued for, or last ran on. */
+    usize cpu() const { return mCPU; }
+    /** CPUs the thread may run on, as a mask with bit n for CPU n. */
+    u32 affinity() const { return mAffinity; }
+
+    /** `true` if the thread's FPU state is loaded when it's switched to. See FPU.hh. */
+    bool isFPUEager() const { return mIsFPUEager; }
+
+    SchedulingClass schedulingClass() const { return mClass; }
+    /** Number of periods in which a deadline thread didn't finish by its deadline. */
+    u32 deadlineMisses() const { return mDeadlineMisses; }
+
+    /** Link on the run queue, or whatever list the thread is waiting on. */
+    kstd::ListNode node;
+    /** Link on the deadline queue, for deadline threads that are ready. */
+    kstd::RBNode deadlineNode;
+
+private:
+    friend struct FPU;
+    friend struct Scheduler;
+
+    u32 mID;
+    const char* mName;
+    State mState;
+    u8 mBasePriority;
+    u8 mPriority;
+
+    Function mFunction;
+    void* mArgument;
+
+    SchedulingClass mClass;
+    /**
+     * @defgroup Deadline
+     * State for the deadline class. The current period started at
+     * mPeriodStart, and mRemainingRuntime is what's left of this period's
+     * runtime, as of when the thread last started running at mRunStart.
+     * @{
+     */
+    DeadlineParameters mDeadlineParameters;
+    u64 mPeriodStart;
+    u64 mAbsoluteDeadline;
+    u64 mRemainingRuntime;
+    u64 mRunStart;
+    u32 mDeadlineMisses;
+    /** Off the CPU until the next period: out of runtime, or done with this period's work. */
+    bool mIsThrottled;
+    /** This period's miss has already been counted. */
+    bool mIsMissCounted;
+    /** Fires when the runtime runs out. Armed while the thread is running. */
+    HighResolutionTimer mBudgetTimer;
+    /** Fires at the start of the next period. Armed while the thread waits for it. */
+    HighResolutionTimer mReplenishTimer;
+    kstd::ListNode mDeadlineThreadsNode;
+    /** @} */
+
+    /** Saved stack pointer while the thread is switched out. */
+    uptr mStackPointer;
+    /**
+     * Set while a CPU is on this thread's stack. Another CPU can only switch
+     * to it once it's clear.
+     */
+    kstd::Atomic<bool> mOnCPU;
+
+    u16 mCPU;
+    u32 mAffinity;
+    /** Clock time the thread last came off a CPU. Its cache there is warm for a while after. */
+    u64 mLastRan;
+
+    /** Ticks left in this thread's time slice. */
+    u32 mTimeSlice;
+    /** `true` if the frames are freed on exit, instead of by join(). */
+    bool mDetached;
+    /** `false` for the boot thread, whose stack isn't ours to free. */
+    bool mOwnsStack;
+    /** Thread waiting in join() for this one. */
+    Thread* mJoiner;
+
+    /**
+     * @defgroup FPU
+     * The thread's FPU and SSE registers. See FPU.hh.
+     * @{
+     */
+    FPUState mFPUState;
+    /** `false` until the thread first uses the FPU. */
+    bool mHasFPUState;
+    bool mIsFPUEager;
+    /** CPU whose registers last held the thread's state, or NoCPU. */
+    u16 mFPUCPU;
+    /** @} */
+
+    u32 mStackCanary;
+};
+
+} /* namespace kernel */
+
+#endif /* __THREAD_HH__ */
@@ -0,0 +1,382 @@
+/* Timer.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * The system tick, sleeping, timeouts, and high resolution timers.
+ */
+
+#include "Timer.hh"
+#include "APIC.hh"
+#include "CPU.hh"
+#include "Clock.hh"
+#include "PIT.hh"
+#include "Scheduler.hh"
+
+namespace {
+
+static kernel::Timer sTimer;
+
+/** How long to run the Local APIC timer against the PIT to calibrate it. */
+const u64 CalibrationNanoseconds = 10000000;
+
+/**
+ * Longest one-shot interval. Keeps the count arithmetic in 64 bits; deadlines
+ * further out than this wake up once a second on the way.
+ */
+const u64 MaxOneShotNanoseconds = 1000000000;
+
+} /* anonymous namespace */
+
+namespace kernel {
+
+/*
+ * Static
+ */
+
+Timer&
+Timer::systemTimer()
+{
+    return sTimer;
+}
+
+/*
+ * Public
+ */
+
+Timer::PerCPU::PerCPU()
+    : wheel(),
+      highResolutionTimers(),
+      lock(),
+      expiryWork(runExpiredTimeouts),
+      nextTick(Never),
+      isTickStopped(false)
+{ }
+
+
+Timer::Timer()
+    : mJiffiesLock(),
+      mJiffies(0),
+      mCPUs(),
+      mUsingLocalAPIC(false),
+      mLocalAPICFrequency(0)
+{ }
+
+
+void
+Timer::initialize()
+{
+    auto& interruptHandler = x86::InterruptHandler::systemInterruptHandler();
+    mUsingLocalAPIC = interruptHandler.isUsingAPIC();
+    if (mUsingLocalAPIC) {
+        mLocalAPICFrequency = calibrateLocalAPIC();
+        interruptHandler.registerHandler(LocalTimerVector, timerInterrupt, this);
+    } else {
+        interruptHandler.registerIRQHandler(0, timerInterrupt, this);
+    }
+    initializeCPU();
+}
+
+
+void
+Timer::initializeCPU()
+{
+    kstd::InterruptGuard guard;
+    PerCPU& local = mCPUs[x86::currentCPU()];
+    const u64 now = Clock::systemClock().nowNanoseconds();
+    // Bring this CPU's wheel up to the present before anything is armed on it.
+    advanceWheel(local, updateJiffies(now));
+    local.nextTick = (now / NanosecondsPerTick + 1) * NanosecondsPerTick;
+    program(local);
+}
+
+
+void
+Timer::sleepTicks(u32 ticks)
+{
+    const u64 target = jiffies() + ticks;
+    while (jiffies() < target) {
+        x86::enableInterruptsAndHalt();
+    }
+}
+
+
+void
+Timer::arm(Timeout& timeout,
+           u32 ticks)
+{
+    // It may be armed on another CPU's wheel. Take it off first, so we never
+    // hold two wheel locks at once.
+    cancel(timeout);
+
+    const usize cpu = x86::currentCPU();
+    PerCPU& local = mCPUs[cpu];
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(local.lock);
+    timeout.expires = jiffies() + ticks;
+    timeout.cpu = cpu;
+    local.wheel.add(timeout);
+}
+
+
+bool
+Timer::cancel(Timeout& timeout)
+{
+    for (;;) {
+        if (!timeout.isArmed()) {
+            return false;
+        }
+        PerCPU& owner = mCPUs[timeout.cpu];
+        kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(owner.lock);
+        // It may have moved or fired before we got the lock.
+        if (timeout.isArmed() && &mCPUs[timeout.cpu] == &owner) {
+            owner.wheel.remove(timeout);
+            return true;
+        }
+    }
+}
+
+
+void
+Timer::arm(HighResolutionTimer& timer,
+           u64 expires)
+{
+    cancel(timer);
+
+    kstd::InterruptGuard interruptGuard;
+    const usize cpu = x86::currentCPU();
+    PerCPU& local = mCPUs[cpu];
+    bool isFirst;
+    {
+        kstd::LockGuard<kstd::SpinLock> guard(local.lock);
+        timer.expires = expires;
+        timer.cpu = cpu;
+        local.highResolutionTimers.insert(timer);
+        isFirst = local.highResolutionTimers.first() == &timer;
+    }
+    if (isFirst) {
+        program(local);
+    }
+}
+
+
+bool
+Timer::cancel(HighResolutionTimer& timer)
+{
+    for (;;) {
+        if (!timer.isArmed()) {
+            return false;
+        }
+        // If it was first in line, the interrupt it was programmed for comes
+        // anyway and finds nothing to do.
+        PerCPU& owner = mCPUs[timer.cpu];
+        kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(owner.lock);
+        if (timer.isArmed() && &mCPUs[timer.cpu] == &owner) {
+            owner.highResolutionTimers.remove(timer);
+            return true;
+        }
+    }
+}
+
+
+void
+Timer::enterIdle()
+{
+    PerCPU& local = mCPUs[x86::currentCPU()];
+    local.isTickStopped = true;
+
+    u64 next;
+    {
+        kstd::LockGuard<kstd::SpinLock> guard(local.lock);
+        next = local.wheel.nextExpiry();
+    }
+    // Skip ticks until the wheel needs one. If it's empty, only a high
+    // resolution timer or some other interrupt will wake us.
+    local.nextTick = next == TimerWheel::Never ? Never : next * NanosecondsPerTick;
+    program(local);
+}
+
+
+void
+Timer::exitIdle(bool restartTick)
+{
+    kstd::InterruptGuard guard;
+    PerCPU& local = mCPUs[x86::currentCPU()];
+    const u64 now = Clock::systemClock().nowNanoseconds();
+    advanceWheel(local, updateJiffies(now));
+    if (restartTick && local.isTickStopped) {
+        local.isTickStopped = false;
+        local.nextTick = (now / NanosecondsPerTick + 1) * NanosecondsPerTick;
+        program(local);
+    }
+}
+
+/*
+ * Private
+ */
+
+u64
+Timer::updateJiffies(u64 now)
+{
+    // Every CPU's tick writes, so check under the lock that we're not
+    // moving it backwards.
+    const u64 jiffiesNow = now / NanosecondsPerTick;
+    mJiffiesLock.writeLock();
+    if (jiffiesNow > mJiffies) {
+        mJiffies = jiffiesNow;
+    }
+    const u64 jiffies = mJiffies;
+    mJiffiesLock.writeUnlock();
+    return jiffies;
+}
+
+
+void
+Timer::advanceWheel(PerCPU& local,
+                    u64 jiffies)
+{
+    kstd::LockGuard<kstd::SpinLock> guard(local.lock);
+    if (local.wheel.advance(jiffies)) {
+        // Run the callbacks in a batch, outside the interrupt.
+        DeferredWork::systemDeferredWork().schedule(local.expiryWork);
+    }
+}
+
+
+void
+Timer::runHighResolutionTimers(PerCPU& local,
+                               u64 now)
+{
+    for (;;) {
+        HighResolutionTimer* timer;
+        {
+            kstd::LockGuard<kstd::SpinLock> guard(local.lock);
+            timer = local.highResolutionTimers.first();
+            if (!timer || timer->expires > now) {
+                return;
+            }
+            local.highResolutionTimers.remove(*timer);
+        }
+        // Unlocked, so the callback can arm timers, including this one.
+        timer->function(*timer);
+    }
+}
+
+
+void
+Timer::program(PerCPU& local)
+{
+    u64 deadline = local.nextTick;
+    {
+        kstd::LockGuard<kstd::SpinLock> guard(local.lock);
+        const HighResolutionTimer* first = local.highResolutionTimers.first();
+        if (first && first->expires < deadline) {
+            deadline = first->expires;
+        }
+    }
+    if (deadline == Never) {
+        stopHardware();
+        return;
+    }
+    const u64 now = Clock::systemClock().nowNanoseconds();
+    startOneShot(deadline > now ? deadline - now : 0);
+}
+
+
+void
+Timer::startOneShot(u64 nanoseconds)
+{
+    if (nanoseconds > MaxOneShotNanoseconds) {
+        nanoseconds = MaxOneShotNanoseconds;
+    }
+    if (mUsingLocalAPIC) {
+        u64 count = (nanoseconds * mLocalAPICFrequency + 999999999) / 1000000000;
+        if (count == 0) {
+            count = 1;      // 0 would stop the timer
+        } else if (count > 0xFFFFFFFF) {
+            count = 0xFFFFFFFF;
+        }
+        auto& localAPIC = x86::InterruptHandler::systemInterruptHandler().localAPIC();
+        localAPIC.startTimer(LocalTimerVector, x86::LocalAPIC::TimerMode::OneShot, u32(count));
+    } else {
+        // The PIT can only wait about 55 ms. If the deadline is further out
+        // than that, we wake up early and go back to sleep.
+        x86::PIT::systemPIT().startOneShot(x86::PIT::countForNanoseconds(nanoseconds));
+    }
+}
+
+
+void
+Timer::stopHardware()
+{
+    if (mUsingLocalAPIC) {
+        x86::InterruptHandler::systemInterruptHandler().localAPIC().stopTimer();
+    } else {
+        x86::PIT::systemPIT().stop();
+    }
+}
+
+
+u32
+Timer::calibrateLocalAPIC()
+{
+    kstd::InterruptGuard guard;
+    auto& pit = x86::PIT::systemPIT();
+    auto& localAPIC = x86::InterruptHandler::systemInterruptHandler().localAPIC();
+
+    // Let the Local APIC timer count down from as high as it goes while PIT
+    // channel 2 measures out a known interval.
+    const u32 pitCount = x86::PIT::countForNanoseconds(CalibrationNanoseconds);
+    const u32 startCount = 0xFFFFFFFF;
+    pit.startChannel2(pitCount);
+    localAPIC.startTimer(LocalTimerVector, x86::LocalAPIC::TimerMode::OneShot, startCount);
+    while (!pit.hasChannel2Expired()) {
+        x86::pause();
+    }
+    const u32 elapsed = startCount - localAPIC.timerCount();
+    localAPIC.stopTimer();
+    pit.stopChannel2();
+
+    return u32(u64(elapsed) * x86::PIT::BaseFrequency / pitCount);
+}
+
+
+bool
+Timer::timerInterrupt(const x86::InterruptFrame&,
+                      void* context)
+{
+    auto self = static_cast<Timer*>(context);
+    PerCPU& local = self->mCPUs[x86::currentCPU()];
+    const u64 now = Clock::systemClock().nowNanoseconds();
+
+    if (now >= local.nextTick) {
+        self->advanceWheel(local, self->updateJiffies(now));
+        Scheduler::systemScheduler().tick();
+        // The next tick boundary, skipping any we slept through. While the
+        // tick is stopped, enterIdle() picks the next one.
+        local.nextTick = local.isTickStopped ? Never : (now / NanosecondsPerTick + 1) * NanosecondsPerTick;
+    }
+    self->runHighResolutionTimers(local, now);
+
+    self->program(local);
+    return true;
+}
+
+
+void
+Timer::runExpiredTimeouts(WorkItem&)
+{
+    PerCPU& local = systemTimer().mCPUs[x86::currentCPU()];
+    for (;;) {
+        Timeout* timeout;
+        {
+            kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(local.lock);
+            timeout = local.wheel.popExpired();
+        }
+        if (!timeout) {
+            break;
+        }
+        timeout->function(*timeout);
+    }
+}
+
+} /* namespace kernel */
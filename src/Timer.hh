@@ -0,0 +1,223 @@
+/* Timer.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * The system tick: a jiffies counter, sleeping for a number of ticks,
+ * timeouts that call back after a number of ticks, and high resolution timers
+ * that call back at a clock time in nanoseconds.
+ *
+ * The timer interrupt comes from the Local APIC timer when interrupts are
+ * routed through the APIC, so every CPU gets its own, and from the PIT
+ * otherwise. Either way it runs in one-shot mode, programmed for whichever
+ * comes first: the next tick, or the next high resolution timer on the CPU.
+ * Tick deadlines are absolute clock times, so the tick doesn't drift. Jiffies
+ * are derived from the TSC clock rather than counted, so they stay right when
+ * ticks are skipped.
+ *
+ * Timeouts are kept in a timer wheel per CPU, and armed on the wheel of the
+ * CPU that arms them. Each tick advances that CPU's wheel, and expired
+ * timeouts run from deferred work on the same CPU. High resolution timers are
+ * kept in a tree per CPU, sorted by deadline, and run right in the timer
+ * interrupt.
+ *
+ * The tick is stopped while a CPU is idle. enterIdle() programs the next
+ * interrupt for the next deadline on the CPU's wheel, or the next high
+ * resolution timer, or not at all if there's neither.
+ */
+
+#ifndef __TIMER_HH__
+#define __TIMER_HH__
+
+#include "CPU.hh"
+#include "DeferredWork.hh"
+#include "Interrupts.hh"
+#include "TimerWheel.hh"
+#include "kstd/RedBlackTree.hh"
+#include "kstd/SeqLock.hh"
+#include "kstd/SpinLock.hh"
+#include "kstd/Types.hh"
+
+namespace kernel {
+
+/** Rate of the periodic tick, in Hz. */
+const u32 TicksPerSecond = 100;
+const u64 NanosecondsPerTick = 1000000000 / TicksPerSecond;
+
+
+/**
+ * A callback that runs at a clock time, to the resolution of the timer
+ * hardware. Callbacks run in the timer interrupt, with interrupts disabled, so
+ * they should be short. A timer can be armed again from its own callback.
+ */
+struct HighResolutionTimer
+{
+    typedef void (*Function)(HighResolutionTimer& timer);
+
+    explicit
+    HighResolutionTimer(Function function)
+        : node(),
+          expires(0),
+          function(function),
+          cpu(0)
+    { }
+
+    /** `true` from when it's armed until just before its callback runs. */
+    bool isArmed() const { return node.isLinked(); }
+
+    kstd::RBNode node;
+    /** Clock time, in nanoseconds, at or after which this timer fires. */
+    u64 expires;
+    Function function;
+    /** CPU the timer is armed on. Owned by the timer code. */
+    u16 cpu;
+};
+
+
+struct Timer
+{
+    static Timer& systemTimer();
+
+    Timer();
+
+    /** Vector of the Local APIC timer interrupt. */
+    static const u8 LocalTimerVector = 0xEF;
+
+    /**
+     * Start the periodic tick. If interrupts go through the APIC, this
+     * calibrates the Local APIC timer against the PIT and uses that;
+     * otherwise it takes over IRQ 0. The clock must be initialized first.
+     */
+    void initialize();
+
+    /**
+     * Start the tick on an application processor. initialize() must have run
+     * on the boot CPU, and there has to be a Local APIC timer to use.
+     */
+    void initializeCPU();
+
+    /** `true` if the tick comes from the Local APIC timer rather than the PIT. */
+    bool isUsingLocalAPIC() const { return mUsingLocalAPIC; }
+
+    /** Rate the Local APIC timer counts down at, in Hz. */
+    u32 localAPICFrequency() const { return mLocalAPICFrequency; }
+
+    /** Number of ticks since the clock was initialized. */
+    u64
+    jiffies()
+        const
+    {
+        u64 jiffies;
+        u32 sequence;
+        do {
+            sequence = mJiffiesLock.readBegin();
+            jiffies = mJiffies;
+        } while (mJiffiesLock.readRetry(sequence));
+        return jiffies;
+    }
+
+    /**
+     * Wait at least `ticks` ticks. For now this halts the CPU between ticks;
+     * call it with interrupts enabled, and never from an interrupt handler.
+     */
+    void sleepTicks(u32 ticks);
+
+    /** Fire `timeout` after `ticks` ticks, on this CPU. Re-arms it if it's already armed. */
+    void arm(Timeout& timeout, u32 ticks);
+
+    /**
+     * Disarm `timeout`.
+     * @return `false` if it wasn't armed, i.e. it already fired or is firing.
+     */
+    bool cancel(Timeout& timeout);
+
+    /**
+     * Fire `timer` once the clock reaches `expires` nanoseconds, on this CPU.
+     * Re-arms it if it's already armed. If `expires` has already passed, it
+     * fires at the next timer interrupt, which is programmed right away.
+     */
+    void arm(HighResolutionTimer& timer, u64 expires);
+
+    /**
+     * Disarm `timer`.
+     * @return `false` if it wasn't armed, i.e. it already fired or is firing.
+     */
+    bool cancel(HighResolutionTimer& timer);
+
+    /**
+     * Stop the periodic tick on this CPU and program a single interrupt for
+     * its next timeout or high resolution timer. Call with interrupts
+     * disabled, right before halting.
+     */
+    void enterIdle();
+
+    /**
+     * Catch up after a halt: bring jiffies up to date and collect the timeouts
+     * that came due. Restart the periodic tick if `restartTick` is `true`,
+     * i.e. there's work to do; otherwise leave it stopped until the next
+     * enterIdle(). The idle loop calls it with `true` on its way out to a
+     * thread, so nothing but idle ever runs without the tick.
+     */
+    void exitIdle(bool restartTick);
+
+private:
+    struct HighResolutionTimerTraits
+    {
+        typedef u64 Key;
+        static Key key(const HighResolutionTimer& timer) { return timer.expires; }
+    };
+
+    typedef kstd::RedBlackTree<HighResolutionTimer, &HighResolutionTimer::node, HighResolutionTimerTraits> HighResolutionTimerTree;
+
+    struct PerCPU
+    {
+        PerCPU();
+
+        TimerWheel wheel;
+        HighResolutionTimerTree highResolutionTimers;
+        /** Protects the wheel and the tree. */
+        kstd::SpinLock lock;
+        /** Runs expired timeouts. */
+        WorkItem expiryWork;
+        /** Clock time of the next tick, or Never while the tick is stopped. */
+        u64 nextTick;
+        /** `true` between enterIdle() and an exitIdle() that restarts the tick. */
+        bool isTickStopped;
+    };
+
+    /** Deadline that never comes. */
+    static const u64 Never = ~u64(0);
+
+    /** Written with interrupts disabled, so a reader can't interrupt a writer on its own CPU. */
+    kstd::SeqLock mJiffiesLock;
+    u64 mJiffies;
+    PerCPU mCPUs[x86::MaxCPUs];
+
+    bool mUsingLocalAPIC;
+    u32 mLocalAPICFrequency;
+
+    /** Bring jiffies up to date with the clock, and return the result. */
+    u64 updateJiffies(u64 now);
+    /** Advance this CPU's wheel to `jiffies`, and schedule expired timeouts. */
+    void advanceWheel(PerCPU& local, u64 jiffies);
+    /** Run this CPU's high resolution timers that are due by `now`. */
+    void runHighResolutionTimers(PerCPU& local, u64 now);
+
+    /**
+     * Program this CPU's timer interrupt for the earlier of its next tick and
+     * its first high resolution timer, or stop it if there's neither. Call
+     * with interrupts disabled.
+     */
+    void program(PerCPU& local);
+    /** Program the timer hardware to interrupt once, after `nanoseconds`. */
+    void startOneShot(u64 nanoseconds);
+    void stopHardware();
+    u32 calibrateLocalAPIC();
+
+    static bool timerInterrupt(const x86::InterruptFrame& frame, void* context);
+    static void runExpiredTimeouts(WorkItem& item);
+};
+
+} /* namespace kernel */
+
+#endif /* __TIMER_HH__ */
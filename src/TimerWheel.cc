@@ -0,0 +1,190 @@
+/* TimerWheel.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * A hierarchical timing wheel for timeouts.
+ */
+
+#include "TimerWheel.hh"
+
+namespace {
+
+const u64 SlotMask = kernel::TimerWheel::SlotsPerLevel - 1;
+
+/** Ticks covered by levels 0 through `level`. */
+inline u64
+levelSpan(u32 level)
+{
+    return u64(1) << (kernel::TimerWheel::LevelBits * (level + 1));
+}
+
+} /* anonymous namespace */
+
+namespace kernel {
+
+/*
+ * Public
+ */
+
+TimerWheel::TimerWheel()
+    : mSlots(),
+      mExpired(),
+      mCurrent(0),
+      mSize(0)
+{ }
+
+
+void
+TimerWheel::add(Timeout& timeout)
+{
+    mSize++;
+    if (timeout.expires <= mCurrent) {
+        file(timeout, ExpiredSlot);
+        return;
+    }
+
+    const u64 delta = timeout.expires - mCurrent;
+    for (u32 level = 0; level < Levels; level++) {
+        if (delta < levelSpan(level)) {
+            const u64 index = (timeout.expires >> (LevelBits * level)) & SlotMask;
+            file(timeout, level * SlotsPerLevel + index);
+            return;
+        }
+    }
+
+    // Too far out. Park it in the furthest slot; it'll be re-filed from there.
+    const u32 level = Levels - 1;
+    const u64 parked = mCurrent + levelSpan(level) - 1;
+    file(timeout, level * SlotsPerLevel + ((parked >> (LevelBits * level)) & SlotMask));
+}
+
+
+void
+TimerWheel::remove(Timeout& timeout)
+{
+    if (timeout.slot == ExpiredSlot) {
+        mExpired.remove(timeout);
+    } else {
+        mSlots[timeout.slot].remove(timeout);
+    }
+    mSize--;
+}
+
+
+bool
+TimerWheel::advance(u64 now)
+{
+    if (mSize == 0) {
+        // Nothing to cascade or expire. After a tickless idle this could be a
+        // very long way.
+        if (mCurrent < now) {
+            mCurrent = now;
+        }
+        return false;
+    }
+    while (mCurrent < now) {
+        if (now - mCurrent > 1) {
+            // Skip straight to the tick before the next slot comes due. The
+            // ticks in between have nothing to do.
+            const u64 due = nextDueSlot();
+            const u64 skipTo = (due < now ? due : now) - 1;
+            if (skipTo > mCurrent) {
+                mCurrent = skipTo;
+            }
+        }
+        mCurrent++;
+        const u64 index = mCurrent & SlotMask;
+        if (index == 0) {
+            cascade(1);
+        }
+        mExpired.splice(mSlots[index]);
+    }
+    return !mExpired.isEmpty();
+}
+
+
+Timeout*
+TimerWheel::popExpired()
+{
+    Timeout* timeout = mExpired.popFront();
+    if (timeout) {
+        mSize--;
+    }
+    return timeout;
+}
+
+
+u64
+TimerWheel::nextExpiry()
+    const
+{
+    if (!mExpired.isEmpty()) {
+        return mCurrent;
+    }
+    if (mSize == 0) {
+        return Never;
+    }
+    return nextDueSlot();
+}
+
+/*
+ * Private
+ */
+
+u64
+TimerWheel::nextDueSlot()
+    const
+{
+    u64 next = Never;
+    for (u32 level = 0; level < Levels; level++) {
+        // Walk this level's slots in the order they come due. A slot at
+        // distance d is reached when the wheel gets to the start of that block.
+        const u32 shift = LevelBits * level;
+        const u64 block = mCurrent >> shift;
+        for (u64 distance = 1; distance <= SlotsPerLevel; distance++) {
+            const u64 start = (block + distance) << shift;
+            if (start >= next) {
+                break;
+            }
+            if (!mSlots[level * SlotsPerLevel + ((block + distance) & SlotMask)].isEmpty()) {
+                next = start;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+
+void
+TimerWheel::cascade(u32 level)
+{
+    const u64 index = (mCurrent >> (LevelBits * level)) & SlotMask;
+    // Higher levels wrap at the same time this one does, and have to go
+    // first: their timeouts may land in this level's current slot.
+    if (index == 0 && level + 1 < Levels) {
+        cascade(level + 1);
+    }
+
+    TimeoutList& slot = mSlots[level * SlotsPerLevel + index];
+    while (Timeout* timeout = slot.popFront()) {
+        mSize--;
+        add(*timeout);
+    }
+}
+
+
+void
+TimerWheel::file(Timeout& timeout,
+                 u16 slot)
+{
+    timeout.slot = slot;
+    if (slot == ExpiredSlot) {
+        mExpired.pushBack(timeout);
+    } else {
+        mSlots[slot].pushBack(timeout);
+    }
+}
+
+} /* namespace kernel */
@@ -0,0 +1,125 @@
+/* TimerWheel.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * A hierarchical timing wheel for timeouts.
+ *
+ * There are four levels of 64 slots. A timeout due within 64 ticks goes in the
+ * level 0 slot for its tick; one due within 64^2 ticks goes in the level 1 slot
+ * covering its block of 64 ticks, and so on. Arming and cancelling are O(1).
+ * Every 64 ticks the next level 1 slot is cascaded: its timeouts are put back
+ * in level 0 at their exact ticks. Level 2 and 3 cascade the same way, every
+ * 64^2 and 64^3 ticks.
+ *
+ * Timeouts further out than 64^4 ticks (about 46 hours at 100 Hz) are parked
+ * in the furthest level 3 slot and re-filed when it cascades.
+ */
+
+#ifndef __TIMERWHEEL_HH__
+#define __TIMERWHEEL_HH__
+
+#include "kstd/List.hh"
+#include "kstd/Types.hh"
+
+namespace kernel {
+
+/**
+ * A callback that runs once its deadline passes. Callbacks run in deferred
+ * work context, with interrupts enabled. A timeout can be armed again from its
+ * own callback.
+ */
+struct Timeout
+{
+    typedef void (*Function)(Timeout& timeout);
+
+    explicit
+    Timeout(Function function)
+        : node(),
+          expires(0),
+          function(function),
+          cpu(0),
+          slot(0)
+    { }
+
+    /** `true` from when it's armed until just before its callback runs. */
+    bool isArmed() const { return node.isLinked(); }
+
+    kstd::ListNode node;
+    /** Jiffy at or after which this timeout fires. */
+    u64 expires;
+    Function function;
+
+    /** @{ Where the timeout is filed. Owned by the timer code. */
+    u16 cpu;
+    u16 slot;
+    /** @} */
+};
+
+
+struct TimerWheel
+{
+    typedef kstd::List<Timeout, &Timeout::node> TimeoutList;
+
+    static const u32 LevelBits = 6;
+    static const u32 SlotsPerLevel = 1 << LevelBits;
+    static const u32 Levels = 4;
+
+    TimerWheel();
+
+    /** Tick the wheel has advanced to. Timeouts due at or before it have expired. */
+    u64 current() const { return mCurrent; }
+
+    /** Number of timeouts filed, including expired ones not yet popped. */
+    usize size() const { return mSize; }
+
+    /** File `timeout` by its `expires` tick. It expires right away if that's already past. */
+    void add(Timeout& timeout);
+
+    /** Unfile `timeout`, which must be in this wheel. */
+    void remove(Timeout& timeout);
+
+    /**
+     * Advance the wheel to tick `now`, cascading as needed and collecting due
+     * timeouts.
+     *
+     * @return `true` if there are expired timeouts to pop.
+     */
+    bool advance(u64 now);
+
+    /** Take the next expired timeout off the wheel, or null if there isn't one. */
+    Timeout* popExpired();
+
+    /** Returned by nextExpiry() when the wheel is empty. */
+    static const u64 Never = ~u64(0);
+
+    /**
+     * The earliest tick at which the wheel needs to be advanced: the exact
+     * deadline of a timeout in level 0, or the tick a higher level slot
+     * cascades, whichever is sooner. Never if the wheel is empty.
+     */
+    u64 nextExpiry() const;
+
+private:
+    /** Slot number of the expired list. Wheel slots are numbered level * SlotsPerLevel + index. */
+    static const u16 ExpiredSlot = Levels * SlotsPerLevel;
+
+    TimeoutList mSlots[Levels * SlotsPerLevel];
+    TimeoutList mExpired;
+    u64 mCurrent;
+    usize mSize;
+
+    /**
+     * The earliest tick after current() at which a non-empty slot comes due,
+     * ignoring the expired list, or Never.
+     */
+    u64 nextDueSlot() const;
+
+    /** Re-file every timeout in the current slot of `level`. */
+    void cascade(u32 level);
+    void file(Timeout& timeout, u16 slot);
+};
+
+} /* namespace kernel */
+
+#endif /* __TIMERWHEEL_HH__ */
@@ -0,0 +1,73 @@
+/* WaitQueue.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Wait queues.
+ */
+
+#include "WaitQueue.hh"
+#include "Scheduler.hh"
+
+namespace kernel {
+
+/*
+ * Public
+ */
+
+WaitQueue::WaitQueue()
+    : mLock(),
+      mWaiters(),
+      mCount(0)
+{ }
+
+
+bool
+WaitQueue::wakeOne()
+{
+    if (!hasWaiters()) {
+        return false;
+    }
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    Thread* thread = mWaiters.popFront();
+    if (!thread) {
+        return false;
+    }
+    mCount.fetchSub(1);
+    Scheduler::systemScheduler().wake(*thread);
+    return true;
+}
+
+
+usize
+WaitQueue::wakeAll()
+{
+    if (!hasWaiters()) {
+        return 0;
+    }
+    auto& scheduler = Scheduler::systemScheduler();
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    usize woken = 0;
+    while (Thread* thread = mWaiters.popFront()) {
+        mCount.fetchSub(1);
+        scheduler.wake(*thread);
+        woken++;
+    }
+    return woken;
+}
+
+/*
+ * Private
+ */
+
+void
+WaitQueue::sleepLocked()
+{
+    auto& scheduler = Scheduler::systemScheduler();
+    mWaiters.pushBack(*scheduler.current());
+    // Only a waker can take us off the queue, and it has to get mLock first,
+    // by which time we're blocked.
+    scheduler.block(mLock);
+}
+
+} /* namespace kernel */
@@ -0,0 +1,114 @@
+/* WaitQueue.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Wait queues: lists of threads blocked waiting for something to happen.
+ *
+ * A waiter checks its condition with the queue locked, and if it isn't met,
+ * goes on the queue and blocks before the lock is released, so a waker that
+ * makes the condition true and then wakes the queue can't slip in between and
+ * leave it asleep. Wakers check for waiters without taking the lock, so waking
+ * an empty queue costs one load:
+ *
+ *     // Waiter
+ *     queue.waitUntil([&] { return isDone.load(); });
+ *
+ *     // Waker
+ *     isDone.store(true);
+ *     queue.wakeAll();
+ *
+ * That works because the waiter counts itself in before it checks, and the
+ * waker checks the count after it writes; with both sequentially consistent,
+ * one of them sees the other. Conditions have to be read with sequentially
+ * consistent atomics for the same reason.
+ *
+ * Waiters are woken first in, first out. Blocked threads are off the run
+ * queues, and take no CPU time until they're woken.
+ */
+
+#ifndef __WAITQUEUE_HH__
+#define __WAITQUEUE_HH__
+
+#include "CPU.hh"
+#include "Thread.hh"
+#include "kstd/Atomic.hh"
+#include "kstd/List.hh"
+#include "kstd/SpinLock.hh"
+#include "kstd/Types.hh"
+
+namespace kernel {
+
+struct WaitQueue
+{
+    WaitQueue();
+
+    /** `true` if a thread is waiting, or about to. */
+    bool hasWaiters() const { return mCount.load() != 0; }
+
+    /**
+     * Sleep on the queue until woken. `shouldSleep()` is called first, with
+     * the queue locked and interrupts disabled; if it returns `false`, the
+     * thread doesn't sleep after all. It mustn't block.
+     *
+     * @return `true` if the thread slept.
+     */
+    template<typename ShouldSleep>
+    bool
+    sleep(ShouldSleep shouldSleep)
+    {
+        const u32 flags = x86::saveFlagsAndDisableInterrupts();
+        mLock.lock();
+        mCount.fetchAdd(1);
+        if (!shouldSleep()) {
+            mCount.fetchSub(1);
+            mLock.unlock();
+            x86::restoreFlags(flags);
+            return false;
+        }
+        sleepLocked();
+        x86::restoreFlags(flags);
+        return true;
+    }
+
+    /**
+     * Sleep until `condition()` is true. It's checked with the queue locked,
+     * first and then each time the thread is woken, and mustn't block.
+     */
+    template<typename Condition>
+    void
+    waitUntil(Condition condition)
+    {
+        while (sleep([&condition]() { return !condition(); })) { }
+    }
+
+    /**
+     * Wake the thread that's been waiting longest. Safe to call from
+     * interrupt handlers.
+     *
+     * @return `false` if nobody was waiting.
+     */
+    bool wakeOne();
+
+    /**
+     * Wake every waiting thread. Safe to call from interrupt handlers.
+     * @return Number of threads woken.
+     */
+    usize wakeAll();
+
+private:
+    kstd::SpinLock mLock;
+    kstd::List<Thread, &Thread::node> mWaiters;
+    /** Threads on mWaiters, and threads about to check whether to join them. */
+    kstd::Atomic<u32> mCount;
+
+    /** Add the calling thread and block. Called with mLock held, which it releases. */
+    void sleepLocked();
+
+    WaitQueue(const WaitQueue& other) = delete;
+    WaitQueue& operator=(const WaitQueue& other) = delete;
+};
+
+} /* namespace kernel */
+
+#endif /* __WAITQUEUE_HH__ */
@@ -7,6 +7,7 @@
  * variables can be initialized properly.
  */
 
+#include "CPU.hh"
 #include "Console.hh"
 
 namespace __cxxabiv1 {
@@ -17,32 +18,51 @@ __extension__ typedef int __guard __attribute__((mode(__DI__)));
 extern "C" {
 
 /*
- * TODO: The functions below are required by the C++ ABI and should be thread
- * safe. Since Polka currently has no threads, it should be fine to do this
- * without any actual locking. Once/If I add threading, I need to come back here
- * and add an actual mutex with a test-and-set.
+ * The C++ ABI says the first byte of the guard is nonzero once the variable is
+ * initialized. The second byte is ours: it's set while some CPU is running the
+ * initializer, so others wait for it to finish.
  *
  * See http://wiki.osdev.org/C%2B%2B#Local_Static_Variables_.28GCC_Only.29
- * See the Intel XCHG instruction
+ * See https://itanium-cxx-abi.github.io/cxx-abi/abi.html#once-ctor
  */
 
 int
 __cxa_guard_acquire(__guard *g)
 {
-    return !*(char *)(g);
+    char *initialized = reinterpret_cast<char *>(g);
+    char *inProgress = initialized + 1;
+    for (;;) {
+        if (__atomic_load_n(initialized, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+        char expected = 0;
+        if (__atomic_compare_exchange_n(inProgress, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            // We might have lost a race with someone who just finished.
+            if (__atomic_load_n(initialized, __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(inProgress, 0, __ATOMIC_RELEASE);
+                return 0;
+            }
+            return 1;
+        }
+        x86::pause();
+    }
 }
 
 
 void
 __cxa_guard_release(__guard *g)
 {
-    *(char *)g = 1;
+    char *initialized = reinterpret_cast<char *>(g);
+    __atomic_store_n(initialized, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(initialized + 1, 0, __ATOMIC_RELEASE);
 }
 
 
 void
-__cxa_guard_abort(__guard *)
+__cxa_guard_abort(__guard *g)
 {
+    __atomic_store_n(reinterpret_cast<char *>(g) + 1, 0, __ATOMIC_RELEASE);
+
     kernel::Console console;
     console.clear(kernel::Console::Color::Red);
     console.printString("OOPS!\n");
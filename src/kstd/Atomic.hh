@@ -0,0 +1,132 @@
+/* Atomic.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Atomic values. A thin wrapper over the GCC `__atomic` builtins, with
+ * explicit memory ordering.
+ */
+
+#ifndef __KSTD_ATOMIC_HH__
+#define __KSTD_ATOMIC_HH__
+
+#include "kstd/Types.hh"
+
+namespace kstd {
+
+enum class MemoryOrder : int {
+    Relaxed = __ATOMIC_RELAXED,
+    Consume = __ATOMIC_CONSUME,
+    Acquire = __ATOMIC_ACQUIRE,
+    Release = __ATOMIC_RELEASE,
+    AcquireRelease = __ATOMIC_ACQ_REL,
+    SequentiallyConsistent = __ATOMIC_SEQ_CST,
+};
+
+/** A compiler-only barrier. Stops the compiler moving memory accesses across it. */
+inline void
+compilerBarrier()
+{
+    asm volatile("" : : : "memory");
+}
+
+
+/** A full memory fence. */
+inline void
+memoryFence(MemoryOrder order = MemoryOrder::SequentiallyConsistent)
+{
+    __atomic_thread_fence(int(order));
+}
+
+
+/**
+ * An atomic T. T should be an integer, bool or pointer type no wider than 8
+ * bytes. Operations default to sequential consistency.
+ */
+template<typename T>
+struct Atomic
+{
+    Atomic()
+        : mValue()
+    { }
+
+    explicit
+    Atomic(T value)
+        : mValue(value)
+    { }
+
+    T
+    load(MemoryOrder order = MemoryOrder::SequentiallyConsistent)
+        const
+    {
+        return __atomic_load_n(&mValue, int(order));
+    }
+
+    void
+    store(T value,
+          MemoryOrder order = MemoryOrder::SequentiallyConsistent)
+    {
+        __atomic_store_n(&mValue, value, int(order));
+    }
+
+    /** Store `value` and return the old value. */
+    T
+    exchange(T value,
+             MemoryOrder order = MemoryOrder::SequentiallyConsistent)
+    {
+        return __atomic_exchange_n(&mValue, value, int(order));
+    }
+
+    /**
+     * If the value is `expected`, replace it with `desired` and return `true`.
+     * Otherwise, load the current value into `expected` and return `false`.
+     */
+    bool
+    compareExchange(T& expected,
+                    T desired,
+                    MemoryOrder order = MemoryOrder::SequentiallyConsistent)
+    {
+        return __atomic_compare_exchange_n(&mValue, &expected, desired, false, int(order), failureOrder(order));
+    }
+
+    /**
+     * @defgroup Fetch Operations
+     * Apply an operation and return the value from before it.
+     * @{
+     */
+    T fetchAdd(T value, MemoryOrder order = MemoryOrder::SequentiallyConsistent) { return __atomic_fetch_add(&mValue, value, int(order)); }
+    T fetchSub(T value, MemoryOrder order = MemoryOrder::SequentiallyConsistent) { return __atomic_fetch_sub(&mValue, value, int(order)); }
+    T fetchAnd(T value, MemoryOrder order = MemoryOrder::SequentiallyConsistent) { return __atomic_fetch_and(&mValue, value, int(order)); }
+    T fetchOr(T value, MemoryOrder order = MemoryOrder::SequentiallyConsistent) { return __atomic_fetch_or(&mValue, value, int(order)); }
+    T fetchXor(T value, MemoryOrder order = MemoryOrder::SequentiallyConsistent) { return __atomic_fetch_xor(&mValue, value, int(order)); }
+    /** @} */
+
+    operator T() const { return load(); }
+    Atomic& operator=(T value) { store(value); return *this; }
+
+    T operator++() { return fetchAdd(1) + 1; }
+    T operator--() { return fetchSub(1) - 1; }
+    T operator++(int) { return fetchAdd(1); }
+    T operator--(int) { return fetchSub(1); }
+    T operator+=(T value) { return fetchAdd(value) + value; }
+    T operator-=(T value) { return fetchSub(value) - value; }
+
+private:
+    T mValue;
+
+    /** The failure ordering for a compare-exchange can't include a release. */
+    static constexpr int
+    failureOrder(MemoryOrder order)
+    {
+        return order == MemoryOrder::Release ? __ATOMIC_RELAXED
+             : order == MemoryOrder::AcquireRelease ? __ATOMIC_ACQUIRE
+             : int(order);
+    }
+
+    Atomic(const Atomic& other) = delete;
+    Atomic& operator=(const Atomic& other) = delete;
+};
+
+} /* namespace kstd */
+
+#endif /* __KSTD_ATOMIC_HH__ */
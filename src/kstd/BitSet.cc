@@ -0,0 +1,311 @@
+/* BitSet.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Implementation of BitSpan.
+ */
+
+#include "kstd/BitSet.hh"
+
+namespace {
+
+/** A word with the low `bits` bits set. */
+inline kstd::BitWord
+lowMask(usize bits)
+{
+    return bits >= kstd::BitsPerWord ? ~kstd::BitWord(0) : (kstd::BitWord(1) << bits) - 1;
+}
+
+
+inline usize
+wordIndex(usize bit)
+{
+    return bit / kstd::BitsPerWord;
+}
+
+
+inline usize
+bitOffset(usize bit)
+{
+    return bit % kstd::BitsPerWord;
+}
+
+} /* anonymous namespace */
+
+namespace kstd {
+
+const usize BitSpan::NotFound;
+
+/*
+ * Iterator
+ */
+
+BitSpan::Iterator::Iterator(const BitSpan& span,
+                            usize bit)
+    : mSpan(span),
+      mBit(bit)
+{ }
+
+
+usize
+BitSpan::Iterator::operator*()
+    const
+{
+    return mBit;
+}
+
+
+BitSpan::Iterator&
+BitSpan::Iterator::operator++()
+{
+    mBit = mSpan.findFirstSet(mBit + 1);
+    return *this;
+}
+
+
+bool
+BitSpan::Iterator::operator==(const Iterator& other)
+    const
+{
+    return mBit == other.mBit;
+}
+
+
+bool
+BitSpan::Iterator::operator!=(const Iterator& other)
+    const
+{
+    return mBit != other.mBit;
+}
+
+/*
+ * Public
+ */
+
+BitSpan::BitSpan()
+    : mWords(nullptr),
+      mSize(0)
+{ }
+
+
+BitSpan::BitSpan(BitWord* words,
+                 usize size)
+    : mWords(words),
+      mSize(size)
+{ }
+
+
+usize
+BitSpan::size()
+    const
+{
+    return mSize;
+}
+
+
+bool
+BitSpan::isSet(usize bit)
+    const
+{
+    if (bit >= mSize) {
+        return false;
+    }
+    return (mWords[wordIndex(bit)] & (BitWord(1) << bitOffset(bit))) != 0;
+}
+
+
+void
+BitSpan::set(usize bit)
+{
+    if (bit >= mSize) {
+        return;
+    }
+    mWords[wordIndex(bit)] |= BitWord(1) << bitOffset(bit);
+}
+
+
+void
+BitSpan::clear(usize bit)
+{
+    if (bit >= mSize) {
+        return;
+    }
+    mWords[wordIndex(bit)] &= ~(BitWord(1) << bitOffset(bit));
+}
+
+
+void
+BitSpan::setRange(usize start,
+                  usize length)
+{
+    writeRange(start, length, true);
+}
+
+
+void
+BitSpan::clearRange(usize start,
+                    usize length)
+{
+    writeRange(start, length, false);
+}
+
+
+void
+BitSpan::zero()
+{
+    const usize words = wordsForBits(mSize);
+    for (usize i = 0; i < words; i++) {
+        mWords[i] = 0;
+    }
+}
+
+
+void
+BitSpan::fill()
+{
+    const usize words = wordsForBits(mSize);
+    for (usize i = 0; i < words; i++) {
+        mWords[i] = ~BitWord(0);
+    }
+    // Keep the bits past the end clear.
+    if (bitOffset(mSize) != 0) {
+        mWords[words - 1] = lowMask(bitOffset(mSize));
+    }
+}
+
+
+usize
+BitSpan::findFirstSet(usize from)
+    const
+{
+    return find(from, 0);
+}
+
+
+usize
+BitSpan::findFirstClear(usize from)
+    const
+{
+    return find(from, ~BitWord(0));
+}
+
+
+usize
+BitSpan::findClearRun(usize length,
+                      usize from)
+    const
+{
+    if (length == 0) {
+        return from < mSize ? from : NotFound;
+    }
+    while (from < mSize) {
+        const usize start = findFirstClear(from);
+        if (start == NotFound || mSize - start < length) {
+            return NotFound;
+        }
+        usize end = findFirstSet(start);
+        if (end == NotFound) {
+            end = mSize;
+        }
+        if (end - start >= length) {
+            return start;
+        }
+        from = end;
+    }
+    return NotFound;
+}
+
+
+usize
+BitSpan::popcount()
+    const
+{
+    const usize words = wordsForBits(mSize);
+    usize count = 0;
+    for (usize i = 0; i < words; i++) {
+        count += __builtin_popcountl(mWords[i]);
+    }
+    return count;
+}
+
+
+BitSpan::Iterator
+BitSpan::begin()
+    const
+{
+    return Iterator(*this, findFirstSet(0));
+}
+
+
+BitSpan::Iterator
+BitSpan::end()
+    const
+{
+    return Iterator(*this, NotFound);
+}
+
+/*
+ * Private
+ */
+
+void
+BitSpan::writeRange(usize start,
+                    usize length,
+                    bool value)
+{
+    if (start >= mSize) {
+        return;
+    }
+    if (length > mSize - start) {
+        length = mSize - start;
+    }
+
+    usize word = wordIndex(start);
+    usize offset = bitOffset(start);
+    while (length > 0) {
+        // Bits to touch in this word: everything from `offset` up, limited by what's left of the range.
+        const usize bits = (BitsPerWord - offset) < length ? (BitsPerWord - offset) : length;
+        const BitWord mask = lowMask(bits) << offset;
+        if (value) {
+            mWords[word] |= mask;
+        } else {
+            mWords[word] &= ~mask;
+        }
+        length -= bits;
+        offset = 0;
+        word++;
+    }
+}
+
+
+/**
+ * Find the first bit at or after `from` whose value, XORed with `invert`, is 1.
+ * Searching with `invert` of all ones finds clear bits.
+ */
+usize
+BitSpan::find(usize from,
+              BitWord invert)
+    const
+{
+    if (from >= mSize) {
+        return NotFound;
+    }
+
+    const usize words = wordsForBits(mSize);
+    usize word = wordIndex(from);
+    // Ignore bits below `from` in the first word.
+    BitWord bits = (mWords[word] ^ invert) & ~lowMask(bitOffset(from));
+    for (;;) {
+        if (bits != 0) {
+            const usize bit = word * BitsPerWord + __builtin_ctzl(bits);
+            return bit < mSize ? bit : NotFound;
+        }
+        if (++word >= words) {
+            return NotFound;
+        }
+        bits = mWords[word] ^ invert;
+    }
+}
+
+} /* namespace kstd */
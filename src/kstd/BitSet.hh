@@ -0,0 +1,141 @@
+/* BitSet.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Multi-word bit sets. A BitSpan is a view over an array of machine words
+ * whose size is only known at runtime; a BitSet<N> owns its words and has a
+ * size fixed at compile time. Bulk and scan operations work a whole word at a
+ * time.
+ */
+
+#ifndef __KSTD_BITSET_HH__
+#define __KSTD_BITSET_HH__
+
+#include "kstd/Types.hh"
+
+namespace kstd {
+
+/** The unit bit sets are stored and scanned in. This is a machine word. */
+typedef unsigned long BitWord;
+
+/** Number of bits in a BitWord. */
+const usize BitsPerWord = sizeof(BitWord) * 8;
+
+/**
+ * A view over `size` bits stored in an array of BitWords. The span does not
+ * own its words. Bits beyond `size` in the last word are kept clear.
+ */
+struct BitSpan
+{
+    /** Returned by the find methods when there is no matching bit. */
+    static const usize NotFound = usize(-1);
+
+    /** Number of words needed to hold `bits` bits. */
+    static constexpr usize
+    wordsForBits(usize bits)
+    {
+        return (bits + BitsPerWord - 1) / BitsPerWord;
+    }
+
+    /** Iterates over the indexes of set bits, in increasing order. */
+    struct Iterator
+    {
+        Iterator(const BitSpan& span, usize bit);
+
+        usize operator*() const;
+        Iterator& operator++();
+
+        bool operator==(const Iterator& other) const;
+        bool operator!=(const Iterator& other) const;
+
+    private:
+        const BitSpan& mSpan;
+        usize mBit;
+    };
+
+    BitSpan();
+    BitSpan(BitWord* words, usize size);
+
+    /** Number of bits in the span. */
+    usize size() const;
+
+    /** Get the status of a single bit. Returns `true` if the bit is 1. */
+    bool isSet(usize bit) const;
+    /** Set a single bit to 1. */
+    void set(usize bit);
+    /** Set a single bit to 0. */
+    void clear(usize bit);
+
+    /** Set `length` bits starting at `start` to 1. */
+    void setRange(usize start, usize length);
+    /** Set `length` bits starting at `start` to 0. */
+    void clearRange(usize start, usize length);
+
+    /** Clear every bit. */
+    void zero();
+    /** Set every bit. */
+    void fill();
+
+    /** Index of the first set bit at or after `from`, or NotFound. */
+    usize findFirstSet(usize from = 0) const;
+    /** Index of the first clear bit at or after `from`, or NotFound. */
+    usize findFirstClear(usize from = 0) const;
+    /** Index of the first run of `length` clear bits at or after `from`, or NotFound. */
+    usize findClearRun(usize length, usize from = 0) const;
+
+    /** Number of set bits. */
+    usize popcount() const;
+
+    /**
+     * Iteration over set bits.
+     * @{
+     */
+    Iterator begin() const;
+    Iterator end() const;
+    /** @} */
+
+private:
+    BitWord* mWords;
+    usize mSize;
+
+    void writeRange(usize start, usize length, bool value);
+    usize find(usize from, BitWord invert) const;
+};
+
+/** A set of `N` bits with storage inline. */
+template<usize N>
+struct BitSet
+{
+    static const usize length = N;
+
+    BitSet()
+        : mWords{0}
+    { }
+
+    /** A span over this set's bits. */
+    BitSpan span() { return BitSpan(mWords, N); }
+    const BitSpan span() const { return BitSpan(const_cast<BitWord*>(mWords), N); }
+
+    bool isSet(usize bit) const { return span().isSet(bit); }
+    void set(usize bit) { span().set(bit); }
+    void clear(usize bit) { span().clear(bit); }
+    void setRange(usize start, usize len) { span().setRange(start, len); }
+    void clearRange(usize start, usize len) { span().clearRange(start, len); }
+    void zero() { span().zero(); }
+    void fill() { span().fill(); }
+    usize findFirstSet(usize from = 0) const { return span().findFirstSet(from); }
+    usize findFirstClear(usize from = 0) const { return span().findFirstClear(from); }
+    usize findClearRun(usize len, usize from = 0) const { return span().findClearRun(len, from); }
+    usize popcount() const { return span().popcount(); }
+
+    /** Direct access to the words, for sets that fit in one. */
+    BitWord word(usize index = 0) const { return mWords[index]; }
+
+private:
+    BitWord mWords[BitSpan::wordsForBits(N)];
+};
+
+} /* namespace kstd */
+
+#endif /* __KSTD_BITSET_HH__ */
@@ -20,7 +20,7 @@ inline bool
 get(T field,
     u8 bit)
 {
-    return (field & (1 << bit)) > 0;
+    return (field & (T(1) << bit)) != 0;
 }
 
 template<typename T>
@@ -28,7 +28,7 @@ inline void
 set(T& field,
     u8 bit)
 {
-    field |= T(1 << bit);
+    field |= T(1) << bit;
 }
 
 template<typename T>
@@ -36,7 +36,7 @@ inline void
 clear(T& field,
       u8 bit)
 {
-    field &= ~T(1 << bit);
+    field &= ~(T(1) << bit);
 }
 
 template<typename T>
@@ -67,7 +67,10 @@ clearMask(T& field,
 
 } /* namespace Bit */
 
-/** An array-like object of N bits, where N is the size of the type T given as a template parameter. */
+/**
+ * An array-like object of N bits, where N is the size of the type T given as a
+ * template parameter. For more bits than fit in one word, see BitSet.hh.
+ */
 template <typename T>
 struct Bitmap
 {
@@ -97,28 +100,28 @@ struct Bitmap
     isSet(usize bit)
         const
     {
-        return (mBitmap & FieldType(1 << bit)) > 0;
+        return (mBitmap & (FieldType(1) << bit)) != 0;
     }
 
     /** Set a single bit to 1. */
     void
     set(usize bit)
     {
-        mBitmap |= FieldType(1 << bit);
+        mBitmap |= FieldType(1) << bit;
     }
 
     /** Set a single bit to zero. */
     void
     clear(usize bit)
     {
-        mBitmap &= ~FieldType(1 << bit);
+        mBitmap &= ~(FieldType(1) << bit);
     }
 
     /** Toggle the state of a single bit. Returns `true` if the bit was set to 1. */
     bool
     toggle(usize bit)
     {
-        mBitmap ^= FieldType(1 << bit);
+        mBitmap ^= FieldType(1) << bit;
         return isSet(bit);
     }
 
@@ -0,0 +1,298 @@
+/* Format.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Type-safe string formatting.
+ */
+
+#include "Kernel.hh"
+#include "kstd/ASCII.hh"
+#include "kstd/CString.hh"
+#include "kstd/Format.hh"
+
+namespace {
+
+/** Write a converted value right aligned in a field of `spec.width` characters. */
+void
+writeField(kstd::FormatOutput& output,
+           const kstd::FormatSpec& spec,
+           const char* str,
+           int length)
+{
+    output.pad(spec.zeroPadded ? '0' : ' ', spec.width - length);
+    output.put(str, length);
+}
+
+
+/**
+ * Parse the spec part of a placeholder, the bit between the colon and the
+ * closing brace.
+ *
+ * @return A pointer to the closing brace, or to the terminator if there isn't one.
+ */
+const char*
+parseSpec(const char* p,
+          kstd::FormatSpec& spec)
+{
+    if (*p == '0') {
+        spec.zeroPadded = true;
+        p++;
+    }
+    while (kstd::Char::isDigit(*p)) {
+        spec.width = 10 * spec.width + (*p - '0');
+        p++;
+    }
+    switch (*p) {
+        case 'X':
+            spec.capitalized = true;
+            // fall through
+        case 'x':
+            spec.base = 16;
+            p++;
+            break;
+        case 'b':
+            spec.base = 2;
+            p++;
+            break;
+        case 'o':
+            spec.base = 8;
+            p++;
+            break;
+        case 'd':
+            spec.base = 10;
+            p++;
+            break;
+    }
+    while (*p != '\0' && *p != '}') {
+        p++;
+    }
+    return p;
+}
+
+} /* anonymous namespace */
+
+namespace kstd {
+
+/*
+ * FormatOutput
+ */
+
+FormatOutput::FormatOutput(char* buffer,
+                           usize length)
+    : mBuffer(buffer),
+      mLength(length),
+      mPosition(0),
+      mTotal(0)
+{ }
+
+
+int
+FormatOutput::total()
+    const
+{
+    return mTotal;
+}
+
+
+usize
+FormatOutput::length()
+    const
+{
+    return mPosition;
+}
+
+
+void
+FormatOutput::put(char c)
+{
+    // Always leave room for the terminator.
+    if (mPosition + 1 < mLength) {
+        mBuffer[mPosition++] = c;
+    }
+    mTotal++;
+}
+
+
+void
+FormatOutput::put(const char* str,
+                  usize length)
+{
+    usize room = (mPosition + 1 < mLength) ? mLength - mPosition - 1 : 0;
+    usize n = length < room ? length : room;
+    for (usize i = 0; i < n; i++) {
+        mBuffer[mPosition++] = str[i];
+    }
+    mTotal += length;
+}
+
+
+void
+FormatOutput::pad(char c,
+                  int count)
+{
+    for (int i = 0; i < count; i++) {
+        put(c);
+    }
+}
+
+
+void
+FormatOutput::terminate()
+{
+    if (mLength > 0) {
+        mBuffer[mPosition] = '\0';
+    }
+}
+
+/*
+ * FormatSpec
+ */
+
+FormatSpec::FormatSpec()
+    : width(0),
+      zeroPadded(false),
+      capitalized(false),
+      base(10)
+{ }
+
+/*
+ * Value Formatters
+ */
+
+void
+formatSigned(FormatOutput& output,
+             const FormatSpec& spec,
+             i64 value)
+{
+    char buf[72];
+    int length = CString::fromInteger(value, buf, sizeof(buf), spec.base, spec.capitalized);
+    writeField(output, spec, buf, length);
+}
+
+
+void
+formatUnsigned(FormatOutput& output,
+               const FormatSpec& spec,
+               u64 value)
+{
+    char buf[72];
+    int length = CString::fromUnsignedInteger(value, buf, sizeof(buf), spec.base, spec.capitalized);
+    writeField(output, spec, buf, length);
+}
+
+
+void
+formatPointer(FormatOutput& output,
+              const FormatSpec& spec,
+              const void* value)
+{
+    // Pointers are always full width, zero padded hex.
+    FormatSpec pointerSpec = spec;
+    pointerSpec.zeroPadded = true;
+    pointerSpec.base = 16;
+    if (pointerSpec.width < int(sizeof(void*) * 2)) {
+        pointerSpec.width = sizeof(void*) * 2;
+    }
+    formatUnsigned(output, pointerSpec, uptr(value));
+}
+
+
+void
+formatString(FormatOutput& output,
+             const FormatSpec& spec,
+             const char* value)
+{
+    if (value == nullptr) {
+        value = "(null)";
+    }
+    FormatSpec stringSpec = spec;
+    stringSpec.zeroPadded = false;
+    writeField(output, stringSpec, value, CString::length(value));
+}
+
+
+void
+formatChar(FormatOutput& output,
+           const FormatSpec& spec,
+           char value)
+{
+    output.pad(' ', spec.width - 1);
+    output.put(value);
+}
+
+
+void
+formatBool(FormatOutput& output,
+           const FormatSpec& spec,
+           bool value)
+{
+    formatString(output, spec, value ? "true" : "false");
+}
+
+/*
+ * Format Strings
+ */
+
+int
+formatArguments(FormatOutput& output,
+                const char* format,
+                const FormatArgument* arguments,
+                usize count)
+{
+    usize argument = 0;
+    const char* p = format;
+    while (*p != '\0') {
+        // Copy the literal segment up to the next brace in one go.
+        const char* segment = p;
+        while (*p != '\0' && *p != '{' && *p != '}') {
+            p++;
+        }
+        output.put(segment, p - segment);
+        if (*p == '\0') {
+            break;
+        }
+
+        // Doubled braces are literal braces.
+        if (p[0] == p[1]) {
+            output.put(*p);
+            p += 2;
+            continue;
+        }
+        if (*p == '}') {
+            // A stray closing brace. Print it as is.
+            output.put(*p++);
+            continue;
+        }
+
+        FormatSpec spec;
+        p++;
+        if (*p == ':') {
+            p = parseSpec(p + 1, spec);
+        }
+        while (*p != '\0' && *p != '}') {
+            p++;
+        }
+        if (*p == '}') {
+            p++;
+        }
+
+        if (argument < count) {
+            arguments[argument++].format(output, spec);
+        } else {
+            // More placeholders than arguments.
+            output.put("{?}", 3);
+        }
+    }
+    return output.total();
+}
+
+
+void
+printFormatted(const char* str,
+               usize length)
+{
+    kernel::Kernel::systemKernel().console().write(str, length);
+}
+
+} /* namespace kstd */
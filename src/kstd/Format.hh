@@ -0,0 +1,246 @@
+/* Format.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Type-safe string formatting. Arguments are formatted by routines chosen at
+ * compile time from their types, so there is no va_arg width to get wrong.
+ *
+ * Format strings use `{}` as a placeholder for the next argument. A
+ * placeholder may carry a spec after a colon: an optional `0` for zero
+ * padding, an optional width, and an optional type of `x`, `X`, `b`, `o`, or
+ * `d`. For example, `{:08X}`. Use `{{` and `}}` for literal braces.
+ *
+ *     kstd::print("Frame {} at 0x{:08X}\n", page, u32(address));
+ */
+
+#ifndef __KSTD_FORMAT_HH__
+#define __KSTD_FORMAT_HH__
+
+#include "kstd/Types.hh"
+
+namespace kstd {
+
+/**
+ * Size of the stack buffer print() and printFormat() render into before
+ * handing the result to the console. Longer messages are truncated.
+ */
+const usize PrintFormatBufferSize = 256;
+
+/**
+ * A bounded character buffer that formatted output is rendered into. Writes
+ * beyond the end of the buffer are dropped, but still counted, so callers can
+ * tell how long the full output would have been.
+ */
+struct FormatOutput
+{
+    FormatOutput(char* buffer, usize length);
+
+    /** Number of characters written, including any that didn't fit. */
+    int total() const;
+
+    /** Number of characters actually in the buffer. */
+    usize length() const;
+
+    void put(char c);
+    void put(const char* str, usize length);
+    void pad(char c, int count);
+
+    /** Null terminate the buffer, truncating if necessary. */
+    void terminate();
+
+private:
+    char* mBuffer;
+    usize mLength;
+    usize mPosition;
+    int mTotal;
+};
+
+/** How a single value should be rendered. */
+struct FormatSpec
+{
+    FormatSpec();
+
+    /** Minimum width of the field. Values are right aligned. */
+    int width;
+    /** Pad with zeros instead of spaces. */
+    bool zeroPadded;
+    /** Use capital letters for digits above 9. */
+    bool capitalized;
+    /** Base for integer values. */
+    u8 base;
+};
+
+/**
+ * @defgroup Value Formatters
+ * Render a single value into `output`. These are shared by the template
+ * formatter below and by printFormat().
+ * @{
+ */
+void formatSigned(FormatOutput& output, const FormatSpec& spec, i64 value);
+void formatUnsigned(FormatOutput& output, const FormatSpec& spec, u64 value);
+void formatPointer(FormatOutput& output, const FormatSpec& spec, const void* value);
+void formatString(FormatOutput& output, const FormatSpec& spec, const char* value);
+void formatChar(FormatOutput& output, const FormatSpec& spec, char value);
+void formatBool(FormatOutput& output, const FormatSpec& spec, bool value);
+/** @} */
+
+/**
+ * Picks the value formatter for a type. Only the types specialized below can
+ * be formatted; anything else is a compile error.
+ */
+template<typename T>
+struct Formatter;
+
+#define KSTD_SIGNED_FORMATTER(Type) \
+    template<> struct Formatter<Type> { \
+        static void format(FormatOutput& o, const FormatSpec& s, Type v) { formatSigned(o, s, v); } \
+    }
+
+#define KSTD_UNSIGNED_FORMATTER(Type) \
+    template<> struct Formatter<Type> { \
+        static void format(FormatOutput& o, const FormatSpec& s, Type v) { formatUnsigned(o, s, v); } \
+    }
+
+KSTD_SIGNED_FORMATTER(signed char);
+KSTD_SIGNED_FORMATTER(short);
+KSTD_SIGNED_FORMATTER(int);
+KSTD_SIGNED_FORMATTER(long);
+KSTD_SIGNED_FORMATTER(long long);
+KSTD_UNSIGNED_FORMATTER(unsigned char);
+KSTD_UNSIGNED_FORMATTER(unsigned short);
+KSTD_UNSIGNED_FORMATTER(unsigned int);
+KSTD_UNSIGNED_FORMATTER(unsigned long);
+KSTD_UNSIGNED_FORMATTER(unsigned long long);
+
+#undef KSTD_SIGNED_FORMATTER
+#undef KSTD_UNSIGNED_FORMATTER
+
+template<>
+struct Formatter<char>
+{
+    static void format(FormatOutput& o, const FormatSpec& s, char v) { formatChar(o, s, v); }
+};
+
+template<>
+struct Formatter<bool>
+{
+    static void format(FormatOutput& o, const FormatSpec& s, bool v) { formatBool(o, s, v); }
+};
+
+template<>
+struct Formatter<const char*>
+{
+    static void format(FormatOutput& o, const FormatSpec& s, const char* v) { formatString(o, s, v); }
+};
+
+template<>
+struct Formatter<char*>
+    : public Formatter<const char*>
+{ };
+
+template<usize N>
+struct Formatter<char[N]>
+    : public Formatter<const char*>
+{ };
+
+template<typename T>
+struct Formatter<T*>
+{
+    static void format(FormatOutput& o, const FormatSpec& s, const T* v) { formatPointer(o, s, v); }
+};
+
+/**
+ * A type-erased reference to a single argument, paired with the formatter
+ * selected for its type at compile time.
+ */
+struct FormatArgument
+{
+    typedef void (*Function)(FormatOutput&, const FormatSpec&, const void*);
+
+    FormatArgument()
+        : mValue(nullptr),
+          mFunction(nullptr)
+    { }
+
+    template<typename T>
+    FormatArgument(const T& value)
+        : mValue(&value),
+          mFunction(&FormatArgument::call<T>)
+    { }
+
+    void
+    format(FormatOutput& output,
+           const FormatSpec& spec)
+        const
+    {
+        mFunction(output, spec, mValue);
+    }
+
+private:
+    const void* mValue;
+    Function mFunction;
+
+    template<typename T>
+    static void
+    call(FormatOutput& output,
+         const FormatSpec& spec,
+         const void* value)
+    {
+        Formatter<T>::format(output, spec, *static_cast<const T*>(value));
+    }
+};
+
+/**
+ * Render `format` into `output`, substituting `arguments` for placeholders.
+ * Literal text between placeholders is copied in whole runs.
+ *
+ * @return Number of characters the full output would have taken.
+ */
+int formatArguments(FormatOutput& output, const char* format, const FormatArgument* arguments, usize count);
+
+/** Write already formatted text to the system console. */
+void printFormatted(const char* str, usize length);
+
+/**
+ * Render a format string into `buffer`, writing at most `length` characters
+ * including the null terminator.
+ * @return Number of characters the full output would have taken.
+ */
+template<typename... Args>
+int
+format(char* buffer,
+       usize length,
+       const char* format,
+       const Args&... args)
+{
+    // One extra element so the array is never zero-sized.
+    const FormatArgument arguments[] = { FormatArgument(args)..., FormatArgument() };
+    FormatOutput output(buffer, length);
+    formatArguments(output, format, arguments, sizeof...(Args));
+    output.terminate();
+    return output.total();
+}
+
+/**
+ * Format a string and write it to the system console.
+ * @return Number of characters printed
+ */
+template<typename... Args>
+int
+print(const char* format,
+      const Args&... args)
+{
+    char buffer[PrintFormatBufferSize];
+    int nchars = kstd::format(buffer, sizeof(buffer), format, args...);
+    usize length = nchars;
+    if (length >= sizeof(buffer)) {
+        length = sizeof(buffer) - 1;
+    }
+    printFormatted(buffer, length);
+    return nchars;
+}
+
+} /* namespace kstd */
+
+#endif /* __KSTD_FORMAT_HH__ */
@@ -0,0 +1,154 @@
+/* HashTable.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Intrusive open hashing table. Each bucket is a circular list of the objects
+ * that hash to it, linked through a ListNode embedded in the object. The
+ * bucket array is part of the table, so nothing is ever allocated.
+ *
+ * The table finds an object's key with `Traits::key()`. Keys are hashed with
+ * kstd::hash() and compared with `==`.
+ *
+ *     struct Waiter {
+ *         uptr address;
+ *         kstd::ListNode link;
+ *     };
+ *     struct WaiterTraits {
+ *         typedef uptr Key;
+ *         static Key key(const Waiter& w) { return w.address; }
+ *     };
+ *     kstd::HashTable<Waiter, &Waiter::link, WaiterTraits, 6> waiters;
+ */
+
+#ifndef __KSTD_HASHTABLE_HH__
+#define __KSTD_HASHTABLE_HH__
+
+#include "kstd/List.hh"
+#include "kstd/Types.hh"
+
+namespace kstd {
+
+/**
+ * @defgroup Hashing
+ * Multiplicative (Fibonacci) hashing. The high bits of the product are the
+ * well mixed ones, so tables should take the top bits of these values.
+ * @{
+ */
+inline u32
+hash(u32 value)
+{
+    return value * 0x9E3779B9u;
+}
+
+inline u32
+hash(u64 value)
+{
+    return hash(u32(value) ^ hash(u32(value >> 32)));
+}
+
+inline u32
+hash(const void* value)
+{
+    return hash(u32(uptr(value)));
+}
+/** @} */
+
+
+/**
+ * A table of T with 2^`Log2Buckets` buckets. Several objects may share a key;
+ * find() returns them in insertion order.
+ */
+template<typename T, ListNode T::*Node, typename Traits, usize Log2Buckets>
+struct HashTable
+{
+    typedef typename Traits::Key Key;
+
+    static const usize BucketCount = usize(1) << Log2Buckets;
+
+    static_assert(Log2Buckets > 0 && Log2Buckets < 32, "HashTable needs between 2 and 2^31 buckets.");
+
+    HashTable()
+        : mSize(0)
+    {
+        for (usize i = 0; i < BucketCount; i++) {
+            mBuckets[i].prev = mBuckets[i].next = &mBuckets[i];
+        }
+    }
+
+    bool isEmpty() const { return mSize == 0; }
+    usize size() const { return mSize; }
+
+    /** Insert `item` at the end of its bucket. */
+    void
+    insert(T& item)
+    {
+        ListNode& bucket = bucketFor(Traits::key(item));
+        (item.*Node).linkBetween(bucket.prev, &bucket);
+        mSize++;
+    }
+
+    /** Remove `item`, which must be in this table. */
+    void
+    remove(T& item)
+    {
+        (item.*Node).unlink();
+        mSize--;
+    }
+
+    /**
+     * Find the first object with `key`. To find the rest, pass the previous
+     * result as `after`.
+     *
+     * @return The object, or null if there are no (more) matches.
+     */
+    T*
+    find(const Key& key,
+         T* after = nullptr)
+        const
+    {
+        const ListNode& bucket = bucketFor(key);
+        const ListNode* node = after ? (after->*Node).next : bucket.next;
+        for (; node != &bucket; node = node->next) {
+            T* item = owner(node);
+            if (Traits::key(*item) == key) {
+                return item;
+            }
+        }
+        return nullptr;
+    }
+
+    /** `true` if any object has `key`. */
+    bool
+    contains(const Key& key)
+        const
+    {
+        return find(key) != nullptr;
+    }
+
+private:
+    ListNode mBuckets[BucketCount];
+    usize mSize;
+
+    static T*
+    owner(const ListNode* node)
+    {
+        return containerOf<T, ListNode, Node>(const_cast<ListNode*>(node));
+    }
+
+    static usize
+    bucketIndex(const Key& key)
+    {
+        return hash(key) >> (32 - Log2Buckets);
+    }
+
+    ListNode& bucketFor(const Key& key) { return mBuckets[bucketIndex(key)]; }
+    const ListNode& bucketFor(const Key& key) const { return mBuckets[bucketIndex(key)]; }
+
+    HashTable(const HashTable& other) = delete;
+    HashTable& operator=(const HashTable& other) = delete;
+};
+
+} /* namespace kstd */
+
+#endif /* __KSTD_HASHTABLE_HH__ */
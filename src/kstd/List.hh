@@ -0,0 +1,229 @@
+/* List.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Intrusive doubly-linked list. Objects embed a ListNode and the list links
+ * those nodes together, so inserting and removing never allocates.
+ *
+ *     struct Thing {
+ *         int value;
+ *         kstd::ListNode link;
+ *     };
+ *     kstd::List<Thing, &Thing::link> things;
+ */
+
+#ifndef __KSTD_LIST_HH__
+#define __KSTD_LIST_HH__
+
+#include "kstd/Types.hh"
+
+namespace kstd {
+
+/**
+ * Find the object that contains `member` at the position described by the
+ * member pointer `Member`.
+ */
+template<typename T, typename M, M T::*Member>
+inline T*
+containerOf(M* member)
+{
+    // Offset of the member within T. Computed from a non-null address so the compiler doesn't get clever.
+    const uptr offset = uptr(&(reinterpret_cast<T*>(16)->*Member)) - 16;
+    return reinterpret_cast<T*>(uptr(member) - offset);
+}
+
+
+/** Links an object into a List. Unlinked nodes have null pointers. */
+struct ListNode
+{
+    ListNode()
+        : prev(nullptr),
+          next(nullptr)
+    { }
+
+    /** `true` if this node is currently in a list. */
+    bool
+    isLinked()
+        const
+    {
+        return next != nullptr;
+    }
+
+    /** Insert this node between `before` and `after`, which must be adjacent. */
+    void
+    linkBetween(ListNode* before,
+                ListNode* after)
+    {
+        prev = before;
+        next = after;
+        before->next = this;
+        after->prev = this;
+    }
+
+    /** Remove this node from whatever list it is in. */
+    void
+    unlink()
+    {
+        prev->next = next;
+        next->prev = prev;
+        prev = next = nullptr;
+    }
+
+    ListNode* prev;
+    ListNode* next;
+
+private:
+    ListNode(const ListNode& other) = delete;
+    ListNode& operator=(const ListNode& other) = delete;
+};
+
+
+/**
+ * A circular doubly-linked list of T, linked through the ListNode at `Node`.
+ * The list does not own its elements.
+ */
+template<typename T, ListNode T::*Node>
+struct List
+{
+    struct Iterator
+    {
+        explicit Iterator(ListNode* node) : mNode(node) { }
+
+        T& operator*() const { return *List::owner(mNode); }
+        T* operator->() const { return List::owner(mNode); }
+
+        // Don't remove the current element while iterating. Use next() to step past it first.
+        Iterator& operator++() { mNode = mNode->next; return *this; }
+
+        bool operator==(const Iterator& other) const { return mNode == other.mNode; }
+        bool operator!=(const Iterator& other) const { return mNode != other.mNode; }
+
+    private:
+        ListNode* mNode;
+    };
+
+    /** The object that owns `node`. */
+    static T*
+    owner(ListNode* node)
+    {
+        return containerOf<T, ListNode, Node>(node);
+    }
+
+    List()
+        : mSize(0)
+    {
+        mHead.prev = mHead.next = &mHead;
+    }
+
+    bool isEmpty() const { return mHead.next == &mHead; }
+    usize size() const { return mSize; }
+
+    T* front() const { return isEmpty() ? nullptr : owner(mHead.next); }
+    T* back() const { return isEmpty() ? nullptr : owner(mHead.prev); }
+
+    /** The element after `item`, or null if `item` is last. */
+    T*
+    next(T& item)
+        const
+    {
+        ListNode* node = (item.*Node).next;
+        return node == &mHead ? nullptr : owner(node);
+    }
+
+    /** The element before `item`, or null if `item` is first. */
+    T*
+    prev(T& item)
+        const
+    {
+        ListNode* node = (item.*Node).prev;
+        return node == &mHead ? nullptr : owner(node);
+    }
+
+    void
+    pushFront(T& item)
+    {
+        (item.*Node).linkBetween(&mHead, mHead.next);
+        mSize++;
+    }
+
+    void
+    pushBack(T& item)
+    {
+        (item.*Node).linkBetween(mHead.prev, &mHead);
+        mSize++;
+    }
+
+    /** Insert `item` immediately before `position`, which must be in this list. */
+    void
+    insertBefore(T& position,
+                 T& item)
+    {
+        ListNode& node = position.*Node;
+        (item.*Node).linkBetween(node.prev, &node);
+        mSize++;
+    }
+
+    /** Remove and return the first element, or null if the list is empty. */
+    T*
+    popFront()
+    {
+        T* item = front();
+        if (item) {
+            remove(*item);
+        }
+        return item;
+    }
+
+    /** Remove and return the last element, or null if the list is empty. */
+    T*
+    popBack()
+    {
+        T* item = back();
+        if (item) {
+            remove(*item);
+        }
+        return item;
+    }
+
+    /** Remove `item`, which must be in this list. */
+    void
+    remove(T& item)
+    {
+        (item.*Node).unlink();
+        mSize--;
+    }
+
+    /** Move every element of `other` to the end of this list. */
+    void
+    splice(List& other)
+    {
+        if (other.isEmpty()) {
+            return;
+        }
+        ListNode* first = other.mHead.next;
+        ListNode* last = other.mHead.prev;
+        first->prev = mHead.prev;
+        mHead.prev->next = first;
+        last->next = &mHead;
+        mHead.prev = last;
+        mSize += other.mSize;
+
+        other.mHead.prev = other.mHead.next = &other.mHead;
+        other.mSize = 0;
+    }
+
+    Iterator begin() const { return Iterator(mHead.next); }
+    Iterator end() const { return Iterator(const_cast<ListNode*>(&mHead)); }
+
+private:
+    ListNode mHead;
+    usize mSize;
+
+    List(const List& other) = delete;
+    List& operator=(const List& other) = delete;
+};
+
+} /* namespace kstd */
+
+#endif /* __KSTD_LIST_HH__ */
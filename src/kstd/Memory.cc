@@ -26,12 +26,15 @@ copy(void* to,
     auto fromBytesEnd = fromBytes + length;
 
     if ((toBytes <= fromBytes && toBytesEnd > fromBytes) || (fromBytes <= toBytes && fromBytesEnd > toBytes)) {
-        // Memory regions cannot overlap. Do nothing...silently. >_<
-        return to;
+        // Memory regions shouldn't overlap, but move() copes if they do.
+        return move(to, from, length);
     }
 
-    // TODO: Copy.
-
+    // A plain loop here could be turned into a call to memcpy, which we don't have.
+    asm volatile("rep movsb"
+                 : "+D"(toBytes), "+S"(fromBytes), "+c"(length)
+                 :
+                 : "memory");
     return to;
 }
 
@@ -47,13 +50,23 @@ move(void* to,
 
     auto toBytes = reinterpret_cast<u8*>(to);
     auto fromBytes = reinterpret_cast<const u8*>(from);
-    auto toBytesEnd = toBytes + length;
-    auto fromBytesEnd = fromBytes + length;
 
-    if ((toBytes <= fromBytes && toBytesEnd > fromBytes) || (fromBytes <= toBytes && fromBytesEnd > toBytes)) {
-        // We have to work backwards here to avoid copying over stuff that we still need to copy.
+    if (toBytes > fromBytes && toBytes < fromBytes + length) {
+        // The end of the source is under the start of the destination. Work
+        // backwards so it's read before it's written over.
+        toBytes += length - 1;
+        fromBytes += length - 1;
+        asm volatile("std\n\t"
+                     "rep movsb\n\t"
+                     "cld"
+                     : "+D"(toBytes), "+S"(fromBytes), "+c"(length)
+                     :
+                     : "memory");
     } else {
-        // Straight forward move.
+        asm volatile("rep movsb"
+                     : "+D"(toBytes), "+S"(fromBytes), "+c"(length)
+                     :
+                     : "memory");
     }
 
     return to;
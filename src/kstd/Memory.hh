@@ -29,4 +29,13 @@ void* set(void* s, u8 value, usize length);
 } /* namespace Memory */
 } /* namespace kstd */
 
+/** Placement new, for constructing objects in memory we got some other way. */
+inline void*
+operator new(usize,
+             void* where)
+    noexcept
+{
+    return where;
+}
+
 #endif /* __MEMORY_HH__ */
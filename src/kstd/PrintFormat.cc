@@ -4,13 +4,18 @@
  */
 /**
  * Declares printFormat(), for writing formatted strings to the appropriate channel.
+ *
+ * This is the printf-style front end. It parses the format string and pulls
+ * values off the va_list, and leaves the rendering to the value formatters in
+ * Format.cc.
  */
 
 #include <stdarg.h>
 #include "Console.hh"
 #include "Kernel.hh"
 #include "kstd/ASCII.hh"
-#include "kstd/CString.hh"
+#include "kstd/Format.hh"
+#include "kstd/PrintFormat.hh"
 #include "kstd/Types.hh"
 
 namespace {
@@ -61,7 +66,7 @@ struct Spec {
     } value;
 
     void clear();
-    int print(kernel::Console& console);
+    void print(kstd::FormatOutput& output);
 };
 
 
@@ -77,95 +82,67 @@ Spec::clear()
 }
 
 
-int
-Spec::print(kernel::Console& console)
+void
+Spec::print(kstd::FormatOutput& output)
 {
-    int nchars = 0;
-    int length = 0;
-    char buf[32];
-    char pad = ' ';
-    char *str = nullptr;
-
-    // Type::Char is a special case because it will always be a single character in length and there is no \0 to terminate it.
-    if (type == Type::Char) {
-        if (width == 0) {
-            width = 1;
-        }
-        for (int i = 1; i < width; i++) {
-            console.printChar(' ');
-        }
-        console.printChar(value.c);
-        return width;
-    }
-
-    if (type == Type::Int || type == Type::Hex || type == Type::Pointer || type == Type::Unsigned) {
-        if (zeroPadded || type == Type::Pointer) {
-            pad = '0';
-        }
-        if (type == Type::Int) {
+    kstd::FormatSpec format;
+    format.width = width;
+    format.zeroPadded = zeroPadded;
+    format.capitalized = capitalized;
+
+    switch (type) {
+        case Type::Char:
+            kstd::formatChar(output, format, value.c);
+            break;
+        case Type::Int:
             switch (size) {
                 case Size::Normal:
-                    length = kstd::CString::fromInteger(value.d, buf, 32);
+                    kstd::formatSigned(output, format, value.d);
                     break;
                 case Size::DoubleShort:
-                    length = kstd::CString::fromInteger(value.hhd, buf, 32);
+                    kstd::formatSigned(output, format, value.hhd);
                     break;
                 case Size::Short:
-                    length = kstd::CString::fromInteger(value.hd, buf, 32);
+                    kstd::formatSigned(output, format, value.hd);
                     break;
                 case Size::Long:
-                    length = kstd::CString::fromInteger(value.ld, buf, 32);
+                    kstd::formatSigned(output, format, value.ld);
                     break;
                 case Size::DoubleLong:
-                    length = kstd::CString::fromInteger(value.lld, buf, 32);
+                    kstd::formatSigned(output, format, value.lld);
                     break;
             }
-        } else if (type == Type::Hex || type == Type::Unsigned) {
+            break;
+        case Type::Hex:
+            format.base = 16;
+            // fall through
+        case Type::Unsigned:
             switch (size) {
                 case Size::Normal:
-                    length = kstd::CString::fromUnsignedInteger(value.x, buf, 32, 16, capitalized);
+                    kstd::formatUnsigned(output, format, value.x);
                     break;
                 case Size::DoubleShort:
-                    length = kstd::CString::fromUnsignedInteger(value.hhx, buf, 32, 16, capitalized);
+                    kstd::formatUnsigned(output, format, value.hhx);
                     break;
                 case Size::Short:
-                    length = kstd::CString::fromUnsignedInteger(value.hx, buf, 32, 16, capitalized);
+                    kstd::formatUnsigned(output, format, value.hx);
                     break;
                 case Size::Long:
-                    length = kstd::CString::fromUnsignedInteger(value.lx, buf, 32, 16, capitalized);
+                    kstd::formatUnsigned(output, format, value.lx);
                     break;
                 case Size::DoubleLong:
-                    length = kstd::CString::fromUnsignedInteger(value.llx, buf, 32, 16, capitalized);
+                    kstd::formatUnsigned(output, format, value.llx);
                     break;
             }
-        } else if (type == Type::Pointer) {
-            length = kstd::CString::fromPointer(value.p, buf, 32, 16, true);
-        }
-        if (width < length) {
-            width = length;
-        }
-        str = buf;
-    } else if (type == Type::String) {
-        length = kstd::CString::length(value.s);
-        if (width < length) {
-            width = length;
-        }
-        str = value.s;
-    } else {
-        // Don't know how to print this.
-        return 0;
+            break;
+        case Type::Pointer:
+            format.capitalized = true;
+            kstd::formatPointer(output, format, value.p);
+            break;
+        case Type::String:
+            kstd::formatString(output, format, value.s);
+            break;
     }
-
-    for (int i = width; i > 0; i--) {
-        if (i <= length) {
-            console.printChar(str[length - i]);
-        }
-        else if (i <= width) {
-            console.printChar(pad);
-        }
-    }
-
-    return nchars;
 }
 
 
@@ -188,8 +165,10 @@ isSpecifier(char c)
 namespace kstd {
 
 int
-printFormat(const char* format,
-            va_list args)
+formatToBuffer(char* buffer,
+               usize length,
+               const char* format,
+               va_list args)
 {
     enum {
         Default = 0,
@@ -198,10 +177,9 @@ printFormat(const char* format,
         Size
     } state = Default;
 
-    auto& cons = kernel::Kernel::systemKernel().console();
-
-    int nchars = 0;
+    FormatOutput output(buffer, length);
     Spec spec;
+    spec.clear();
 
     for (const char* p = format; *p != 0; p++) {
         switch (state) {
@@ -210,15 +188,13 @@ printFormat(const char* format,
                     state = Percent;
                     spec.clear();
                 } else {
-                    cons.printChar(*p);
-                    nchars++;
+                    output.put(*p);
                 }
                 break;
             case Percent:
                 if (*p == '%') {
                     state = Default;
-                    cons.printChar(*p);
-                    nchars++;
+                    output.put(*p);
                 } else if (Char::isDigit(*p)) {
                     if (*p == '0' && !spec.zeroPadded) {
                         spec.zeroPadded = true;
@@ -250,8 +226,7 @@ printFormat(const char* format,
                 }
                 break;
             default:
-                cons.printChar(*p);
-                nchars++;
+                output.put(*p);
                 break;
         }
         continue;
@@ -324,10 +299,42 @@ printFormat(const char* format,
                 spec.type = Spec::Type::Hex;
                 break;
         }
-        nchars += spec.print(cons);
+        spec.print(output);
         continue;
     }
 
+    output.terminate();
+    return output.total();
+}
+
+
+int
+formatToBuffer(char* buffer,
+               usize length,
+               const char* format,
+               ...)
+{
+    va_list args;
+    va_start(args, format);
+    int nchars = formatToBuffer(buffer, length, format, args);
+    va_end(args);
+    return nchars;
+}
+
+
+int
+printFormat(const char* format,
+            va_list args)
+{
+    char buffer[PrintFormatBufferSize];
+    int nchars = formatToBuffer(buffer, sizeof(buffer), format, args);
+
+    // Long messages are truncated to what fit in the buffer.
+    usize length = nchars;
+    if (length >= sizeof(buffer)) {
+        length = sizeof(buffer) - 1;
+    }
+    kernel::Kernel::systemKernel().console().write(buffer, length);
     return nchars;
 }
 
@@ -11,9 +11,22 @@
 
 #include <stdarg.h>
 #include "Attributes.hh"
+#include "kstd/Format.hh"
+#include "kstd/Types.hh"
 
 namespace kstd {
 
+/**
+ * Render a format string into `buffer`, writing at most `length` characters
+ * including the null terminator. Behaves like snprintf().
+ * @return Number of characters the full output would have taken, not including
+ *         the terminator. If this is >= `length`, the output was truncated.
+ * @{
+ */
+int formatToBuffer(char* buffer, usize length, const char* format, ...) PRINTF(3,4);
+int formatToBuffer(char* buffer, usize length, const char* format, va_list args);
+/** @} */
+
 /**
  * Write a format string to the appropriate output channel.
  * @return Number of characters printed
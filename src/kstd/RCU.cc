@@ -0,0 +1,240 @@
+/* RCU.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Quiescent-state-based read-copy-update.
+ */
+
+#include "kstd/RCU.hh"
+
+namespace {
+
+static kstd::RCU sRCU;
+
+} /* anonymous namespace */
+
+namespace kstd {
+
+PER_CPU x86::PerCPU<u32> RCU::sReadDepth;
+PER_CPU x86::PerCPU<bool> RCU::sIsIdle;
+
+/*
+ * Static
+ */
+
+RCU&
+RCU::systemRCU()
+{
+    return sRCU;
+}
+
+/*
+ * Public
+ */
+
+RCU::RCU()
+    : mLock(),
+      mOnlineCPUs(1u << 0),    // The boot CPU.
+      mIdleCPUs(0),
+      mWaitingCPUs(0),
+      mCurrent(0),
+      mCompleted(0)
+{
+    mNext.clear();
+    mWaiting.clear();
+    mDone.clear();
+}
+
+
+void
+RCU::setCPUOnline(usize cpu,
+                  bool online)
+{
+    const u32 bit = 1u << cpu;
+    {
+        InterruptSafeLockGuard<SpinLock> guard(mLock);
+        if (online) {
+            // Joins at the next grace period. It can't hold references from
+            // before it came up, so the current one doesn't need to wait.
+            mOnlineCPUs |= bit;
+        } else {
+            mOnlineCPUs &= ~bit;
+            mIdleCPUs &= ~bit;
+            reportLocked(bit);
+        }
+    }
+    runCallbacks();
+}
+
+
+void
+RCU::quiescentState()
+{
+    if (sReadDepth.load() != 0) {
+        return;
+    }
+    const usize cpu = x86::currentCPU();
+
+    const u32 bit = 1u << cpu;
+    if ((mWaitingCPUs.load(MemoryOrder::Relaxed) & bit) == 0 && mDone.isEmpty()) {
+        // Nothing to report and nothing to run.
+        return;
+    }
+
+    {
+        InterruptSafeLockGuard<SpinLock> guard(mLock);
+        reportLocked(bit);
+    }
+    runCallbacks();
+}
+
+
+void
+RCU::enterIdle()
+{
+    const usize cpu = x86::currentCPU();
+    const u32 bit = 1u << cpu;
+    InterruptSafeLockGuard<SpinLock> guard(mLock);
+    mIdleCPUs |= bit;
+    sIsIdle.store(true);
+    // Idle is as quiescent as it gets. Callbacks this finishes off run the
+    // next time the CPU passes through quiescentState().
+    reportLocked(bit);
+}
+
+
+void
+RCU::call(RCUHead* head,
+          RCUHead::Callback callback)
+{
+    head->callback = callback;
+    InterruptSafeLockGuard<SpinLock> guard(mLock);
+    mNext.append(head);
+    if (mWaitingCPUs.load(MemoryOrder::Relaxed) == 0) {
+        startGracePeriodLocked();
+    }
+}
+
+
+void
+RCU::synchronize()
+{
+    struct Waiter
+    {
+        RCUHead head;
+        Atomic<bool> done;
+    };
+
+    Waiter waiter;
+    waiter.done.store(false, MemoryOrder::Relaxed);
+    call(&waiter.head, [](RCUHead* head) {
+        // head is the first member of Waiter.
+        reinterpret_cast<Waiter*>(head)->done.store(true, MemoryOrder::Release);
+    });
+
+    while (!waiter.done.load(MemoryOrder::Acquire)) {
+        quiescentState();
+        x86::pause();
+    }
+}
+
+/*
+ * Private
+ */
+
+void
+RCU::reportLocked(u32 cpus)
+{
+    // Order the earlier reads of RCU data before the report.
+    const u32 waiting = mWaitingCPUs.fetchAnd(~cpus, MemoryOrder::AcquireRelease);
+    if (waiting != 0 && (waiting & ~cpus) == 0) {
+        // These were the last CPUs holding up the grace period.
+        mCompleted.store(mCurrent, MemoryOrder::Release);
+        mDone.appendAll(mWaiting);
+        startGracePeriodLocked();
+    }
+}
+
+
+void
+RCU::startGracePeriodLocked()
+{
+    if (mNext.isEmpty() || mOnlineCPUs == 0) {
+        return;
+    }
+    mWaiting.appendAll(mNext);
+    mCurrent++;
+    const u32 waiting = mOnlineCPUs & ~mIdleCPUs;
+    if (waiting == 0) {
+        // Everyone's idle, so nobody can be holding a reference.
+        mCompleted.store(mCurrent, MemoryOrder::Release);
+        mDone.appendAll(mWaiting);
+        return;
+    }
+    mWaitingCPUs.store(waiting, MemoryOrder::Release);
+}
+
+
+void
+RCU::leaveIdle()
+{
+    const usize cpu = x86::currentCPU();
+    InterruptSafeLockGuard<SpinLock> guard(mLock);
+    // Grace periods that start after this wait for us. Ones that started
+    // before it didn't, but their old versions were already unpublished, and
+    // taking the lock orders our next reads after that.
+    mIdleCPUs &= ~(1u << cpu);
+    sIsIdle.store(false);
+}
+
+
+void
+RCU::runCallbacks()
+{
+    CallbackList done;
+    done.clear();
+    {
+        InterruptSafeLockGuard<SpinLock> guard(mLock);
+        done.appendAll(mDone);
+    }
+
+    RCUHead* head = done.head;
+    while (head) {
+        // The callback may free the head, so step past it first.
+        RCUHead* next = head->next;
+        head->callback(head);
+        head = next;
+    }
+}
+
+
+void
+RCU::CallbackList::clear()
+{
+    head = nullptr;
+    tail = &head;
+}
+
+
+void
+RCU::CallbackList::append(RCUHead* item)
+{
+    item->next = nullptr;
+    *tail = item;
+    tail = &item->next;
+}
+
+
+void
+RCU::CallbackList::appendAll(CallbackList& other)
+{
+    if (other.isEmpty()) {
+        return;
+    }
+    *tail = other.head;
+    tail = other.tail;
+    other.clear();
+}
+
+} /* namespace kstd */
@@ -0,0 +1,202 @@
+/* RCU.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Read-copy-update for read-mostly kernel data, in the quiescent-state-based
+ * style: read-side critical sections cost nothing but a per-CPU counter, and
+ * writers defer freeing old versions until every CPU has passed through a
+ * quiescent state -- a point where it can't be holding a reference, like the
+ * idle loop or a context switch.
+ *
+ * Readers:
+ *
+ *     rcu.readLock();
+ *     auto* table = kstd::rcuDereference(sTable);
+ *     ... use table ...
+ *     rcu.readUnlock();
+ *
+ * Writers copy the data, publish the new version with rcuAssign(), and hand
+ * the old one to call(). Readers must not block or yield inside a read-side
+ * critical section.
+ *
+ * A CPU that halts in the idle loop can't report quiescent states, so it
+ * drops out of grace periods with enterIdle() while it sleeps, and rejoins
+ * with exitIdle() before it reads anything again.
+ */
+
+#ifndef __KSTD_RCU_HH__
+#define __KSTD_RCU_HH__
+
+#include "CPU.hh"
+#include "PerCPU.hh"
+#include "kstd/Atomic.hh"
+#include "kstd/SpinLock.hh"
+#include "kstd/Types.hh"
+
+namespace kstd {
+
+/**
+ * Embed one of these in an object to defer work on it until after a grace
+ * period. There's no kernel heap yet, so the callback is responsible for
+ * returning the object to wherever it came from.
+ */
+struct RCUHead
+{
+    typedef void (*Callback)(RCUHead* head);
+
+    RCUHead* next;
+    Callback callback;
+};
+
+
+/** Read an RCU-protected pointer. */
+template<typename T>
+inline T*
+rcuDereference(T* const& pointer)
+{
+    return __atomic_load_n(&pointer, __ATOMIC_CONSUME);
+}
+
+
+/** Publish a new version of an RCU-protected pointer. */
+template<typename T>
+inline void
+rcuAssign(T*& pointer,
+          T* value)
+{
+    __atomic_store_n(&pointer, value, __ATOMIC_RELEASE);
+}
+
+
+struct RCU
+{
+    static RCU& systemRCU();
+
+    RCU();
+
+    /** Mark a CPU online. It must report quiescent states from now on. */
+    void setCPUOnline(usize cpu, bool online);
+
+    /**
+     * @defgroup Read Side
+     * Read-side critical sections may nest. They don't touch any shared
+     * cache lines: each is one increment and one decrement of a per-CPU
+     * counter.
+     * @{
+     */
+    void
+    readLock()
+    {
+        sReadDepth.add(1);
+        compilerBarrier();
+    }
+
+    void
+    readUnlock()
+    {
+        compilerBarrier();
+        sReadDepth.subtract(1);
+    }
+
+    bool
+    isInReadSection()
+        const
+    {
+        return sReadDepth.load() != 0;
+    }
+    /** @} */
+
+    /**
+     * Report that this CPU holds no RCU references. Call it from the idle loop
+     * and on context switch. Runs any callbacks whose grace period ended.
+     * Cheap when there's no grace period waiting on this CPU.
+     */
+    void quiescentState();
+
+    /**
+     * @defgroup Idle
+     * An idle CPU is in an extended quiescent state: grace periods don't wait
+     * for it. Call enterIdle() from the idle loop, outside any read-side
+     * critical section, right before halting. exitIdle() has to come before
+     * the next read-side critical section, so interrupt dispatch calls it too;
+     * it's cheap when the CPU isn't idle.
+     * @{
+     */
+    void enterIdle();
+
+    void
+    exitIdle()
+    {
+        if (sIsIdle.load()) {
+            leaveIdle();
+        }
+    }
+    /** @} */
+
+    /** Run `callback` on `head` once every CPU has passed a quiescent state. */
+    void call(RCUHead* head, RCUHead::Callback callback);
+
+    /**
+     * Wait for a full grace period. The caller must not be in a read-side
+     * critical section, and other CPUs must be able to make progress.
+     */
+    void synchronize();
+
+    /** Number of completed grace periods. */
+    u32 completedGracePeriods() const { return mCompleted.load(MemoryOrder::Acquire); }
+
+private:
+    /** A singly-linked FIFO of callbacks. */
+    struct CallbackList
+    {
+        RCUHead* head;
+        RCUHead** tail;
+
+        void clear();
+        bool isEmpty() const { return head == nullptr; }
+        void append(RCUHead* item);
+        void appendAll(CallbackList& other);
+    };
+
+    /** Read-side nesting depth. */
+    static x86::PerCPU<u32> sReadDepth;
+    /** This CPU's bit in mIdleCPUs, where it can be checked without the lock. */
+    static x86::PerCPU<bool> sIsIdle;
+
+    SpinLock mLock;
+    /** CPUs participating in grace periods. */
+    u32 mOnlineCPUs;
+    /** Online CPUs that grace periods don't wait for, because they're idle. */
+    u32 mIdleCPUs;
+    /** CPUs that haven't yet reported a quiescent state in the current grace period. */
+    Atomic<u32> mWaitingCPUs;
+    /** Number of the grace period in progress, or of the last one if none is. */
+    u32 mCurrent;
+    /** Number of the last completed grace period. */
+    Atomic<u32> mCompleted;
+
+    /** Callbacks queued since the current grace period started. */
+    CallbackList mNext;
+    /** Callbacks waiting for the current grace period to end. */
+    CallbackList mWaiting;
+    /** Callbacks whose grace period has ended. */
+    CallbackList mDone;
+
+    /**
+     * Report that the CPUs in `cpus` have passed a quiescent state, and end
+     * the grace period if they were the last ones holding it up. Lock must be
+     * held.
+     */
+    void reportLocked(u32 cpus);
+    /** Start a grace period if there are callbacks waiting for one. Lock must be held. */
+    void startGracePeriodLocked();
+    /** Slow path of exitIdle(). */
+    void leaveIdle();
+    /** Run callbacks in mDone. */
+    void runCallbacks();
+};
+
+} /* namespace kstd */
+
+#endif /* __KSTD_RCU_HH__ */
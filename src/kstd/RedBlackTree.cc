@@ -0,0 +1,333 @@
+/* RedBlackTree.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Rebalancing and traversal for red-black trees. The algorithms follow
+ * Cormen et al., Introduction to Algorithms, chapter 13, with null pointers
+ * standing in for the black leaves.
+ */
+
+#include "kstd/RedBlackTree.hh"
+
+namespace {
+
+typedef kstd::RBNode::Color Color;
+
+inline bool
+isRed(const kstd::RBNode* node)
+{
+    return node && node->color == Color::Red;
+}
+
+
+inline bool
+isBlack(const kstd::RBNode* node)
+{
+    return !isRed(node);
+}
+
+} /* anonymous namespace */
+
+namespace kstd {
+
+/*
+ * Public
+ */
+
+RBTreeBase::RBTreeBase()
+    : mRoot(nullptr),
+      mSize(0)
+{ }
+
+
+RBNode*
+RBTreeBase::first()
+    const
+{
+    RBNode* node = mRoot;
+    while (node && node->left) {
+        node = node->left;
+    }
+    return node;
+}
+
+
+RBNode*
+RBTreeBase::last()
+    const
+{
+    RBNode* node = mRoot;
+    while (node && node->right) {
+        node = node->right;
+    }
+    return node;
+}
+
+
+RBNode*
+RBTreeBase::next(const RBNode* node)
+{
+    if (node->right) {
+        RBNode* next = node->right;
+        while (next->left) {
+            next = next->left;
+        }
+        return next;
+    }
+    // Walk up until we come from a left child.
+    RBNode* parent = node->parent;
+    while (parent && node == parent->right) {
+        node = parent;
+        parent = parent->parent;
+    }
+    return parent;
+}
+
+
+RBNode*
+RBTreeBase::prev(const RBNode* node)
+{
+    if (node->left) {
+        RBNode* prev = node->left;
+        while (prev->right) {
+            prev = prev->right;
+        }
+        return prev;
+    }
+    RBNode* parent = node->parent;
+    while (parent && node == parent->left) {
+        node = parent;
+        parent = parent->parent;
+    }
+    return parent;
+}
+
+/*
+ * Protected
+ */
+
+void
+RBTreeBase::link(RBNode* node,
+                 RBNode* parent,
+                 RBNode** link)
+{
+    node->parent = parent;
+    node->left = node->right = nullptr;
+    node->color = Color::Red;
+    *link = node;
+    mSize++;
+    insertFixup(node);
+}
+
+
+void
+RBTreeBase::erase(RBNode* node)
+{
+    RBNode* moved = node;
+    Color movedColor = moved->color;
+    RBNode* child;
+    RBNode* childParent;
+
+    if (!node->left) {
+        child = node->right;
+        childParent = node->parent;
+        transplant(node, node->right);
+    } else if (!node->right) {
+        child = node->left;
+        childParent = node->parent;
+        transplant(node, node->left);
+    } else {
+        // Two children: replace the node with its successor.
+        moved = node->right;
+        while (moved->left) {
+            moved = moved->left;
+        }
+        movedColor = moved->color;
+        child = moved->right;
+        if (moved->parent == node) {
+            childParent = moved;
+        } else {
+            childParent = moved->parent;
+            transplant(moved, moved->right);
+            moved->right = node->right;
+            moved->right->parent = moved;
+        }
+        transplant(node, moved);
+        moved->left = node->left;
+        moved->left->parent = moved;
+        moved->color = node->color;
+    }
+
+    mSize--;
+    node->parent = node->left = node->right = nullptr;
+    node->color = Color::Unlinked;
+
+    if (movedColor == Color::Black) {
+        eraseFixup(child, childParent);
+    }
+}
+
+/*
+ * Private
+ */
+
+void
+RBTreeBase::rotateLeft(RBNode* node)
+{
+    RBNode* pivot = node->right;
+    node->right = pivot->left;
+    if (pivot->left) {
+        pivot->left->parent = node;
+    }
+    transplant(node, pivot);
+    pivot->left = node;
+    node->parent = pivot;
+}
+
+
+void
+RBTreeBase::rotateRight(RBNode* node)
+{
+    RBNode* pivot = node->left;
+    node->left = pivot->right;
+    if (pivot->right) {
+        pivot->right->parent = node;
+    }
+    transplant(node, pivot);
+    pivot->right = node;
+    node->parent = pivot;
+}
+
+
+/** Put `replacement` where `node` is in the tree. `node`'s own links are left alone. */
+void
+RBTreeBase::transplant(RBNode* node,
+                       RBNode* replacement)
+{
+    RBNode* parent = node->parent;
+    if (!parent) {
+        mRoot = replacement;
+    } else if (node == parent->left) {
+        parent->left = replacement;
+    } else {
+        parent->right = replacement;
+    }
+    if (replacement) {
+        replacement->parent = parent;
+    }
+}
+
+
+void
+RBTreeBase::insertFixup(RBNode* node)
+{
+    while (isRed(node->parent)) {
+        RBNode* parent = node->parent;
+        // The parent is red, so it isn't the root, and the grandparent exists.
+        RBNode* grandparent = parent->parent;
+        if (parent == grandparent->left) {
+            RBNode* uncle = grandparent->right;
+            if (isRed(uncle)) {
+                parent->color = uncle->color = Color::Black;
+                grandparent->color = Color::Red;
+                node = grandparent;
+                continue;
+            }
+            if (node == parent->right) {
+                rotateLeft(parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->color = Color::Black;
+            grandparent->color = Color::Red;
+            rotateRight(grandparent);
+        } else {
+            RBNode* uncle = grandparent->left;
+            if (isRed(uncle)) {
+                parent->color = uncle->color = Color::Black;
+                grandparent->color = Color::Red;
+                node = grandparent;
+                continue;
+            }
+            if (node == parent->left) {
+                rotateRight(parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->color = Color::Black;
+            grandparent->color = Color::Red;
+            rotateLeft(grandparent);
+        }
+    }
+    mRoot->color = Color::Black;
+}
+
+
+/**
+ * Restore the red-black properties after removing a black node. `node` is the
+ * node that took its place, which may be null, so its parent is passed
+ * separately.
+ */
+void
+RBTreeBase::eraseFixup(RBNode* node,
+                       RBNode* parent)
+{
+    while (node != mRoot && isBlack(node)) {
+        if (node == parent->left) {
+            RBNode* sibling = parent->right;
+            if (isRed(sibling)) {
+                sibling->color = Color::Black;
+                parent->color = Color::Red;
+                rotateLeft(parent);
+                sibling = parent->right;
+            }
+            if (isBlack(sibling->left) && isBlack(sibling->right)) {
+                sibling->color = Color::Red;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (isBlack(sibling->right)) {
+                sibling->left->color = Color::Black;
+                sibling->color = Color::Red;
+                rotateRight(sibling);
+                sibling = parent->right;
+            }
+            sibling->color = parent->color;
+            parent->color = Color::Black;
+            sibling->right->color = Color::Black;
+            rotateLeft(parent);
+        } else {
+            RBNode* sibling = parent->left;
+            if (isRed(sibling)) {
+                sibling->color = Color::Black;
+                parent->color = Color::Red;
+                rotateRight(parent);
+                sibling = parent->left;
+            }
+            if (isBlack(sibling->left) && isBlack(sibling->right)) {
+                sibling->color = Color::Red;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (isBlack(sibling->left)) {
+                sibling->right->color = Color::Black;
+                sibling->color = Color::Red;
+                rotateLeft(sibling);
+                sibling = parent->left;
+            }
+            sibling->color = parent->color;
+            parent->color = Color::Black;
+            sibling->left->color = Color::Black;
+            rotateRight(parent);
+        }
+        node = mRoot;
+    }
+    if (node) {
+        node->color = Color::Black;
+    }
+}
+
+} /* namespace kstd */
@@ -0,0 +1,196 @@
+/* RedBlackTree.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Intrusive red-black tree. Objects embed an RBNode; the tree links them
+ * together and never allocates. Insertion, removal and search are O(log n),
+ * and iteration is in key order.
+ *
+ * The tree finds an object's key with `Traits::key()` and orders keys with
+ * `<`. Objects with equal keys are kept in insertion order.
+ */
+
+#ifndef __KSTD_REDBLACKTREE_HH__
+#define __KSTD_REDBLACKTREE_HH__
+
+#include "kstd/List.hh"
+#include "kstd/Types.hh"
+
+namespace kstd {
+
+/** Links an object into a RedBlackTree. */
+struct RBNode
+{
+    enum class Color : u8 {
+        Unlinked,
+        Red,
+        Black,
+    };
+
+    RBNode()
+        : parent(nullptr),
+          left(nullptr),
+          right(nullptr),
+          color(Color::Unlinked)
+    { }
+
+    /** `true` if this node is currently in a tree. */
+    bool isLinked() const { return color != Color::Unlinked; }
+
+    RBNode* parent;
+    RBNode* left;
+    RBNode* right;
+    Color color;
+
+private:
+    RBNode(const RBNode& other) = delete;
+    RBNode& operator=(const RBNode& other) = delete;
+};
+
+
+/**
+ * The untyped part of the tree: linking, rebalancing and walking. This is
+ * shared by every RedBlackTree instantiation.
+ */
+struct RBTreeBase
+{
+    RBTreeBase();
+
+    bool isEmpty() const { return mRoot == nullptr; }
+    usize size() const { return mSize; }
+
+    RBNode* first() const;
+    RBNode* last() const;
+    static RBNode* next(const RBNode* node);
+    static RBNode* prev(const RBNode* node);
+
+protected:
+    RBNode* mRoot;
+    usize mSize;
+
+    /**
+     * Attach `node` as a child of `parent` at `link`, which must be one of
+     * `parent`'s empty child pointers (or the root pointer if `parent` is
+     * null), then rebalance.
+     */
+    void link(RBNode* node, RBNode* parent, RBNode** link);
+
+    /** Remove `node` from the tree and rebalance. */
+    void erase(RBNode* node);
+
+private:
+    void rotateLeft(RBNode* node);
+    void rotateRight(RBNode* node);
+    void transplant(RBNode* node, RBNode* replacement);
+    void insertFixup(RBNode* node);
+    void eraseFixup(RBNode* node, RBNode* parent);
+
+    RBTreeBase(const RBTreeBase& other) = delete;
+    RBTreeBase& operator=(const RBTreeBase& other) = delete;
+};
+
+
+/** A tree of T, linked through the RBNode at `Node` and ordered by `Traits::key()`. */
+template<typename T, RBNode T::*Node, typename Traits>
+struct RedBlackTree
+    : public RBTreeBase
+{
+    typedef typename Traits::Key Key;
+
+    struct Iterator
+    {
+        explicit Iterator(RBNode* node) : mNode(node) { }
+
+        T& operator*() const { return *RedBlackTree::owner(mNode); }
+        T* operator->() const { return RedBlackTree::owner(mNode); }
+        Iterator& operator++() { mNode = RBTreeBase::next(mNode); return *this; }
+
+        bool operator==(const Iterator& other) const { return mNode == other.mNode; }
+        bool operator!=(const Iterator& other) const { return mNode != other.mNode; }
+
+    private:
+        RBNode* mNode;
+    };
+
+    /** The object that owns `node`, or null if `node` is null. */
+    static T*
+    owner(RBNode* node)
+    {
+        return node ? containerOf<T, RBNode, Node>(node) : nullptr;
+    }
+
+    void
+    insert(T& item)
+    {
+        const Key key = Traits::key(item);
+        RBNode* parent = nullptr;
+        RBNode** link = &mRoot;
+        while (*link) {
+            parent = *link;
+            // Equal keys go right, so they stay in insertion order.
+            link = (key < Traits::key(*owner(parent))) ? &parent->left : &parent->right;
+        }
+        RBTreeBase::link(&(item.*Node), parent, link);
+    }
+
+    /** Remove `item`, which must be in this tree. */
+    void
+    remove(T& item)
+    {
+        erase(&(item.*Node));
+    }
+
+    T* first() const { return owner(RBTreeBase::first()); }
+    T* last() const { return owner(RBTreeBase::last()); }
+    T* next(T& item) const { return owner(RBTreeBase::next(&(item.*Node))); }
+    T* prev(T& item) const { return owner(RBTreeBase::prev(&(item.*Node))); }
+
+    /** Remove and return the first item, or null if the tree is empty. */
+    T*
+    popFirst()
+    {
+        T* item = first();
+        if (item) {
+            remove(*item);
+        }
+        return item;
+    }
+
+    /** The first item whose key is not less than `key`, or null. */
+    T*
+    lowerBound(const Key& key)
+        const
+    {
+        RBNode* node = mRoot;
+        RBNode* bound = nullptr;
+        while (node) {
+            if (Traits::key(*owner(node)) < key) {
+                node = node->right;
+            } else {
+                bound = node;
+                node = node->left;
+            }
+        }
+        return owner(bound);
+    }
+
+    /** The first item whose key equals `key`, or null. */
+    T*
+    find(const Key& key)
+        const
+    {
+        T* item = lowerBound(key);
+        if (item && !(key < Traits::key(*item))) {
+            return item;
+        }
+        return nullptr;
+    }
+
+    Iterator begin() const { return Iterator(RBTreeBase::first()); }
+    Iterator end() const { return Iterator(nullptr); }
+};
+
+} /* namespace kstd */
+
+#endif /* __KSTD_REDBLACKTREE_HH__ */
@@ -0,0 +1,249 @@
+/* RingBuffer.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Lock-free ring buffers for handing data from one context to another, e.g.
+ * from an interrupt handler to a task, without disabling interrupts.
+ *
+ * Indexes run freely and wrap at 2^32; the slot for an index is found by
+ * masking with the capacity, which must be a power of two. The buffer is
+ * empty when head == tail and full when tail - head == capacity.
+ */
+
+#ifndef __KSTD_RINGBUFFER_HH__
+#define __KSTD_RINGBUFFER_HH__
+
+#include "kstd/Types.hh"
+
+namespace kstd {
+
+/** Cache line size. Indexes written by different sides live on different lines. */
+const usize CacheLineSize = 64;
+
+/**
+ * A ring buffer with exactly one producer and one consumer. The producer only
+ * writes the tail and the consumer only writes the head, so neither side
+ * needs an atomic read-modify-write.
+ */
+template<typename T, usize N>
+struct RingBuffer
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "RingBuffer capacity must be a power of two.");
+
+    static const usize capacity = N;
+
+    RingBuffer()
+        : mHead(0),
+          mTail(0)
+    { }
+
+    /** Number of items in the buffer. Only a snapshot if the other side is running. */
+    usize
+    size()
+        const
+    {
+        return __atomic_load_n(&mTail, __ATOMIC_ACQUIRE) - __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+    }
+
+    bool isEmpty() const { return size() == 0; }
+    bool isFull() const { return size() == N; }
+
+    /**
+     * Producer: add an item.
+     * @return `false` if the buffer was full.
+     */
+    bool
+    push(const T& item)
+    {
+        return pushMany(&item, 1) == 1;
+    }
+
+    /**
+     * Producer: add up to `count` items.
+     * @return Number of items added.
+     */
+    usize
+    pushMany(const T* items,
+             usize count)
+    {
+        const u32 tail = __atomic_load_n(&mTail, __ATOMIC_RELAXED);
+        // Acquire pairs with the consumer's release so we don't overwrite slots it's still reading.
+        const u32 head = __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+        const usize room = N - (tail - head);
+        if (count > room) {
+            count = room;
+        }
+        for (usize i = 0; i < count; i++) {
+            mItems[(tail + i) & (N - 1)] = items[i];
+        }
+        // Release publishes the items before the new tail.
+        __atomic_store_n(&mTail, u32(tail + count), __ATOMIC_RELEASE);
+        return count;
+    }
+
+    /**
+     * Consumer: remove an item.
+     * @return `false` if the buffer was empty.
+     */
+    bool
+    pop(T& item)
+    {
+        return popMany(&item, 1) == 1;
+    }
+
+    /**
+     * Consumer: remove up to `count` items.
+     * @return Number of items removed.
+     */
+    usize
+    popMany(T* items,
+            usize count)
+    {
+        const u32 head = __atomic_load_n(&mHead, __ATOMIC_RELAXED);
+        const u32 tail = __atomic_load_n(&mTail, __ATOMIC_ACQUIRE);
+        const usize available = tail - head;
+        if (count > available) {
+            count = available;
+        }
+        for (usize i = 0; i < count; i++) {
+            items[i] = mItems[(head + i) & (N - 1)];
+        }
+        __atomic_store_n(&mHead, u32(head + count), __ATOMIC_RELEASE);
+        return count;
+    }
+
+private:
+    /** Next slot to read. Written by the consumer. */
+    alignas(CacheLineSize) u32 mHead;
+    /** Next slot to write. Written by the producer. */
+    alignas(CacheLineSize) u32 mTail;
+    T mItems[N];
+
+    RingBuffer(const RingBuffer& other) = delete;
+    RingBuffer& operator=(const RingBuffer& other) = delete;
+};
+
+
+/**
+ * A ring buffer with any number of producers and one consumer. Producers
+ * claim slots by advancing a reservation index with `cmpxchg`, fill them in,
+ * and then publish them in reservation order by advancing the tail.
+ *
+ * A producer waits for the producers that reserved before it to publish, so
+ * code that can interrupt a producer on the same CPU must not push to the same
+ * buffer unless the producer has interrupts disabled.
+ */
+template<typename T, usize N>
+struct MultiProducerRingBuffer
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "MultiProducerRingBuffer capacity must be a power of two.");
+
+    static const usize capacity = N;
+
+    MultiProducerRingBuffer()
+        : mHead(0),
+          mReserved(0),
+          mTail(0)
+    { }
+
+    usize
+    size()
+        const
+    {
+        return __atomic_load_n(&mTail, __ATOMIC_ACQUIRE) - __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+    }
+
+    bool isEmpty() const { return size() == 0; }
+
+    /**
+     * Producer: add an item.
+     * @return `false` if the buffer was full.
+     */
+    bool
+    push(const T& item)
+    {
+        return pushMany(&item, 1) == 1;
+    }
+
+    /**
+     * Producer: add up to `count` items. The items are published together.
+     * @return Number of items added.
+     */
+    usize
+    pushMany(const T* items,
+             usize count)
+    {
+        u32 start = __atomic_load_n(&mReserved, __ATOMIC_RELAXED);
+        usize n;
+        do {
+            const u32 head = __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+            const usize room = N - (start - head);
+            n = count < room ? count : room;
+            if (n == 0) {
+                return 0;
+            }
+        } while (!__atomic_compare_exchange_n(&mReserved, &start, u32(start + n), true,
+                                              __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+        for (usize i = 0; i < n; i++) {
+            mItems[(start + i) & (N - 1)] = items[i];
+        }
+
+        // Wait for earlier reservations to be published, then publish ours.
+        // Acquire the earlier producers' items, so our release of mTail
+        // carries them to the consumer too.
+        while (__atomic_load_n(&mTail, __ATOMIC_ACQUIRE) != start) {
+            asm volatile("pause");
+        }
+        __atomic_store_n(&mTail, u32(start + n), __ATOMIC_RELEASE);
+        return n;
+    }
+
+    /**
+     * Consumer: remove an item.
+     * @return `false` if the buffer was empty.
+     */
+    bool
+    pop(T& item)
+    {
+        return popMany(&item, 1) == 1;
+    }
+
+    /**
+     * Consumer: remove up to `count` items.
+     * @return Number of items removed.
+     */
+    usize
+    popMany(T* items,
+            usize count)
+    {
+        const u32 head = __atomic_load_n(&mHead, __ATOMIC_RELAXED);
+        const u32 tail = __atomic_load_n(&mTail, __ATOMIC_ACQUIRE);
+        const usize available = tail - head;
+        if (count > available) {
+            count = available;
+        }
+        for (usize i = 0; i < count; i++) {
+            items[i] = mItems[(head + i) & (N - 1)];
+        }
+        __atomic_store_n(&mHead, u32(head + count), __ATOMIC_RELEASE);
+        return count;
+    }
+
+private:
+    /** Next slot to read. Written by the consumer. */
+    alignas(CacheLineSize) u32 mHead;
+    /** Next slot to hand to a producer. */
+    alignas(CacheLineSize) u32 mReserved;
+    /** End of the published slots. Everything before this is readable. */
+    u32 mTail;
+    T mItems[N];
+
+    MultiProducerRingBuffer(const MultiProducerRingBuffer& other) = delete;
+    MultiProducerRingBuffer& operator=(const MultiProducerRingBuffer& other) = delete;
+};
+
+} /* namespace kstd */
+
+#endif /* __KSTD_RINGBUFFER_HH__ */
@@ -0,0 +1,125 @@
+/* SeqLock.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Sequence locks, for small read-mostly data. Readers never write anything:
+ * they read a sequence number, copy the data, and check that the sequence
+ * number hasn't changed. Writers bump the sequence number to an odd value
+ * before changing the data and back to even after.
+ *
+ *     u32 seq;
+ *     do {
+ *         seq = lock.readBegin();
+ *         copy = data;
+ *     } while (lock.readRetry(seq));
+ */
+
+#ifndef __KSTD_SEQLOCK_HH__
+#define __KSTD_SEQLOCK_HH__
+
+#include "CPU.hh"
+#include "kstd/Atomic.hh"
+#include "kstd/SpinLock.hh"
+#include "kstd/Types.hh"
+
+namespace kstd {
+
+struct SeqLock
+{
+    SeqLock()
+        : mSequence(0),
+          mWriteLock()
+    { }
+
+    /** Start a read. Waits for any write in progress to finish. */
+    u32
+    readBegin()
+        const
+    {
+        u32 sequence;
+        while ((sequence = mSequence.load(MemoryOrder::Acquire)) & 1) {
+            x86::pause();
+        }
+        return sequence;
+    }
+
+    /** Finish a read. Returns `true` if a write happened and the read must be retried. */
+    bool
+    readRetry(u32 sequence)
+        const
+    {
+        // Keep the data loads above the sequence load below.
+        memoryFence(MemoryOrder::Acquire);
+        return mSequence.load(MemoryOrder::Relaxed) != sequence;
+    }
+
+    /**
+     * Start a write. Writers are serialized with a spinlock. If the data is
+     * also written from an interrupt handler, hold an InterruptGuard across the
+     * write.
+     */
+    void
+    writeLock()
+    {
+        mWriteLock.lock();
+        mSequence.store(mSequence.load(MemoryOrder::Relaxed) + 1, MemoryOrder::Relaxed);
+        // Keep the data stores below the sequence store above.
+        memoryFence(MemoryOrder::Release);
+    }
+
+    void
+    writeUnlock()
+    {
+        mSequence.store(mSequence.load(MemoryOrder::Relaxed) + 1, MemoryOrder::Release);
+        mWriteLock.unlock();
+    }
+
+private:
+    Atomic<u32> mSequence;
+    SpinLock mWriteLock;
+
+    SeqLock(const SeqLock& other) = delete;
+    SeqLock& operator=(const SeqLock& other) = delete;
+};
+
+
+/** A value of T protected by a SeqLock. T should be small and trivially copyable. */
+template<typename T>
+struct SeqLocked
+{
+    SeqLocked()
+        : mLock(),
+          mValue()
+    { }
+
+    /** Get a consistent copy of the value. */
+    T
+    read()
+        const
+    {
+        T value;
+        u32 sequence;
+        do {
+            sequence = mLock.readBegin();
+            value = mValue;
+        } while (mLock.readRetry(sequence));
+        return value;
+    }
+
+    void
+    write(const T& value)
+    {
+        mLock.writeLock();
+        mValue = value;
+        mLock.writeUnlock();
+    }
+
+private:
+    SeqLock mLock;
+    T mValue;
+};
+
+} /* namespace kstd */
+
+#endif /* __KSTD_SEQLOCK_HH__ */
@@ -0,0 +1,293 @@
+/* SpinLock.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Spinning locks and the RAII guards that hold them.
+ *
+ * SpinLock is a ticket lock: waiters are served in the order they arrived.
+ * MCSLock is a queue lock for heavily contended paths: each waiter spins on
+ * its own node instead of on a shared cache line.
+ *
+ * A lock that is also taken in an interrupt handler must be held with
+ * interrupts disabled, or the handler can deadlock against the code it
+ * interrupted. Use InterruptSafeLockGuard for those.
+ *
+ * Build with CONFIG_LOCK_STATISTICS to count acquisitions and contention.
+ */
+
+#ifndef __KSTD_SPINLOCK_HH__
+#define __KSTD_SPINLOCK_HH__
+
+#include "CPU.hh"
+#include "kstd/Atomic.hh"
+#include "kstd/Types.hh"
+
+namespace kstd {
+
+#ifdef CONFIG_LOCK_STATISTICS
+/** Contention counters for a single lock. */
+struct LockStatistics
+{
+    /** Number of times the lock was taken. */
+    Atomic<u32> acquisitions;
+    /** Number of times a caller found the lock held and had to wait. */
+    Atomic<u32> contentions;
+    /** Total number of times waiters went around their spin loop. */
+    Atomic<u32> spins;
+
+    void
+    record(u32 spinCount)
+    {
+        acquisitions.fetchAdd(1, MemoryOrder::Relaxed);
+        if (spinCount > 0) {
+            contentions.fetchAdd(1, MemoryOrder::Relaxed);
+            spins.fetchAdd(spinCount, MemoryOrder::Relaxed);
+        }
+    }
+};
+#endif
+
+
+/** A fair ticket spinlock. */
+struct SpinLock
+{
+    SpinLock()
+        : mNext(0),
+          mServing(0)
+    { }
+
+    void
+    lock()
+    {
+        const u16 ticket = mNext.fetchAdd(1, MemoryOrder::Relaxed);
+        u32 spins = 0;
+        while (mServing.load(MemoryOrder::Acquire) != ticket) {
+            x86::pause();
+            spins++;
+        }
+#ifdef CONFIG_LOCK_STATISTICS
+        mStatistics.record(spins);
+#else
+        (void)spins;
+#endif
+    }
+
+    /** Take the lock only if nobody holds it. Returns `true` if it was taken. */
+    bool
+    tryLock()
+    {
+        u16 serving = mServing.load(MemoryOrder::Relaxed);
+        u16 expected = serving;
+        if (!mNext.compareExchange(expected, u16(serving + 1), MemoryOrder::Acquire)) {
+            return false;
+        }
+#ifdef CONFIG_LOCK_STATISTICS
+        mStatistics.record(0);
+#endif
+        return true;
+    }
+
+    void
+    unlock()
+    {
+        // Only the holder writes mServing, so a plain increment is fine.
+        mServing.store(u16(mServing.load(MemoryOrder::Relaxed) + 1), MemoryOrder::Release);
+    }
+
+    bool
+    isLocked()
+        const
+    {
+        return mNext.load(MemoryOrder::Relaxed) != mServing.load(MemoryOrder::Relaxed);
+    }
+
+#ifdef CONFIG_LOCK_STATISTICS
+    const LockStatistics& statistics() const { return mStatistics; }
+#endif
+
+private:
+    /** Next ticket to hand out. */
+    Atomic<u16> mNext;
+    /** Ticket currently allowed to hold the lock. */
+    Atomic<u16> mServing;
+#ifdef CONFIG_LOCK_STATISTICS
+    LockStatistics mStatistics;
+#endif
+
+    SpinLock(const SpinLock& other) = delete;
+    SpinLock& operator=(const SpinLock& other) = delete;
+};
+
+
+/**
+ * An MCS queue lock. Each waiter brings a Node, usually on its stack, and
+ * spins on a flag in that node. The lock itself is a single tail pointer.
+ */
+struct MCSLock
+{
+    struct Node
+    {
+        Node()
+            : next(nullptr),
+              locked(false)
+        { }
+
+        Atomic<Node*> next;
+        Atomic<bool> locked;
+    };
+
+    MCSLock()
+        : mTail(nullptr)
+    { }
+
+    void
+    lock(Node& node)
+    {
+        node.next.store(nullptr, MemoryOrder::Relaxed);
+        node.locked.store(true, MemoryOrder::Relaxed);
+
+        u32 spins = 0;
+        Node* previous = mTail.exchange(&node, MemoryOrder::AcquireRelease);
+        if (previous) {
+            previous->next.store(&node, MemoryOrder::Release);
+            while (node.locked.load(MemoryOrder::Acquire)) {
+                x86::pause();
+                spins++;
+            }
+        }
+#ifdef CONFIG_LOCK_STATISTICS
+        mStatistics.record(spins);
+#else
+        (void)spins;
+#endif
+    }
+
+    void
+    unlock(Node& node)
+    {
+        Node* next = node.next.load(MemoryOrder::Acquire);
+        if (!next) {
+            // No known successor. If we're still the tail, the lock is free.
+            Node* expected = &node;
+            if (mTail.compareExchange(expected, nullptr, MemoryOrder::Release)) {
+                return;
+            }
+            // Someone is between swapping the tail and linking to us. Wait for them.
+            while (!(next = node.next.load(MemoryOrder::Acquire))) {
+                x86::pause();
+            }
+        }
+        next->locked.store(false, MemoryOrder::Release);
+    }
+
+#ifdef CONFIG_LOCK_STATISTICS
+    const LockStatistics& statistics() const { return mStatistics; }
+#endif
+
+private:
+    Atomic<Node*> mTail;
+#ifdef CONFIG_LOCK_STATISTICS
+    LockStatistics mStatistics;
+#endif
+
+    MCSLock(const MCSLock& other) = delete;
+    MCSLock& operator=(const MCSLock& other) = delete;
+};
+
+
+/** Holds a lock for the lifetime of the guard. */
+template<typename Lock>
+struct LockGuard
+{
+    explicit
+    LockGuard(Lock& lock)
+        : mLock(lock)
+    {
+        mLock.lock();
+    }
+
+    ~LockGuard()
+    {
+        mLock.unlock();
+    }
+
+private:
+    Lock& mLock;
+
+    LockGuard(const LockGuard& other) = delete;
+    LockGuard& operator=(const LockGuard& other) = delete;
+};
+
+
+/** An MCS lock guard carries its own queue node. */
+template<>
+struct LockGuard<MCSLock>
+{
+    explicit
+    LockGuard(MCSLock& lock)
+        : mLock(lock),
+          mNode()
+    {
+        mLock.lock(mNode);
+    }
+
+    ~LockGuard()
+    {
+        mLock.unlock(mNode);
+    }
+
+private:
+    MCSLock& mLock;
+    MCSLock::Node mNode;
+
+    LockGuard(const LockGuard& other) = delete;
+    LockGuard& operator=(const LockGuard& other) = delete;
+};
+
+
+/**
+ * Disables interrupts for the lifetime of the guard and restores EFLAGS.IF to
+ * whatever it was before. Guards may nest.
+ */
+struct InterruptGuard
+{
+    InterruptGuard()
+        : mFlags(x86::saveFlagsAndDisableInterrupts())
+    { }
+
+    ~InterruptGuard()
+    {
+        x86::restoreFlags(mFlags);
+    }
+
+private:
+    u32 mFlags;
+
+    InterruptGuard(const InterruptGuard& other) = delete;
+    InterruptGuard& operator=(const InterruptGuard& other) = delete;
+};
+
+
+/**
+ * Disables interrupts, then takes the lock. On the way out the lock is
+ * released before interrupts are restored.
+ */
+template<typename Lock>
+struct InterruptSafeLockGuard
+{
+    explicit
+    InterruptSafeLockGuard(Lock& lock)
+        : mInterrupts(),
+          mGuard(lock)
+    { }
+
+private:
+    // Members are destroyed in reverse order, so this order matters.
+    InterruptGuard mInterrupts;
+    LockGuard<Lock> mGuard;
+};
+
+} /* namespace kstd */
+
+#endif /* __KSTD_SPINLOCK_HH__ */
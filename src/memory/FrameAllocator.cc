@@ -8,7 +8,7 @@
  */
 
 #include "Kernel.hh"
-#include "kstd/Memory.hh"
+#include "kstd/Format.hh"
 #include "kstd/PrintFormat.hh"
 #include "memory/FrameAllocator.hh"
 #include "memory/Memory.hh"
@@ -16,31 +16,28 @@
 namespace kernel {
 
 FrameAllocator::FrameAllocator()
-    : mBitmap(nullptr),
-      mBitmapSize(0)
+    : mLock(),
+      mFrames(),
+      mBitmapSize(0),
+      mNumberOfPages(0)
 { }
 
 
 void
 FrameAllocator::initialize(const StartupInformation& startupInformation)
 {
-    // Page frame bitmap starts immediately after the kernel.
-    mBitmap = reinterpret_cast<Bitmap*>(startupInformation.kernelEnd);
-
     mNumberOfPages = startupInformation.memorySize() / memory::pageSize;
-    const u32 pagesPerBitmap = Bitmap::length;
 
-    mBitmapSize = mNumberOfPages / pagesPerBitmap;
-    if ((mNumberOfPages % pagesPerBitmap) != 0) {
-        // Add an extra bitmap for the last few pages.
-        mBitmapSize++;
-    }
+    // Page frame bitmap starts immediately after the kernel.
+    auto words = reinterpret_cast<kstd::BitWord*>(startupInformation.kernelEnd);
+    mFrames = kstd::BitSpan(words, mNumberOfPages);
+    mBitmapSize = kstd::BitSpan::wordsForBits(mNumberOfPages) * sizeof(kstd::BitWord);
 
-    kstd::printFormat("Allocated bitmap of %ld bytes for %ld pages at 0x%08lX\n", mBitmapSize * sizeof(Bitmap), mNumberOfPages, u32(mBitmap));
+    kstd::print("Allocated bitmap of {} bytes for {} pages at 0x{:08X}\n", mBitmapSize, mNumberOfPages, u32(words));
 
     // TODO: Before modifying this memory, maybe make sure none of the multiboot information is hanging out there?
 
-    kstd::Memory::zero(mBitmap, mBitmapSize);
+    mFrames.zero();
 
     // Lower 1 MB is always allocated.
     reserveRange(0, 0x100000);
@@ -51,67 +48,50 @@ FrameAllocator::initialize(const StartupInformation& startupInformation)
 void*
 FrameAllocator::allocate()
 {
-    // Find the first bitmap with a free slot, and the first free slot, and return it.
-    const u32 pagesPerBitmap = Bitmap::length;
-    for (usize i = 0; i < mNumberOfPages; i++) {
-        auto& bitmap = mBitmap[i];
-        if (bitmap.isFull()) {
-            continue;
-        }
-        for (usize j = 0; j < pagesPerBitmap; j++) {
-            if (bitmap.isSet(j)) {
-                continue;
-            }
-            bitmap.set(j);
-            usize page = i * pagesPerBitmap + j;
-            void* pageAddress = addressOfPage(page);
-            kstd::printFormat("Allocating frame for page %ld at address 0x%08lX\n", page, u32(pageAddress));
-            return pageAddress;
-        }
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    usize page = mFrames.findFirstClear();
+    if (page == kstd::BitSpan::NotFound) {
+        kstd::printFormat("Couldn't allocate frame\n");
+        return nullptr;
+    }
+    mFrames.set(page);
+    void* pageAddress = addressOfPage(page);
+    kstd::print("Allocating frame for page {} at address 0x{:08X}\n", page, u32(pageAddress));
+    return pageAddress;
+}
+
+void*
+FrameAllocator::allocateContiguous(usize count)
+{
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    usize page = mFrames.findClearRun(count);
+    if (page == kstd::BitSpan::NotFound) {
+        kstd::print("Couldn't allocate {} contiguous frames\n", count);
+        return nullptr;
     }
-    kstd::printFormat("Couldn't allocate frame\n");
-    return nullptr;
+    mFrames.setRange(page, count);
+    return addressOfPage(page);
+}
+
+void
+FrameAllocator::free(void* frame,
+                     usize count)
+{
+    kstd::InterruptSafeLockGuard<kstd::SpinLock> guard(mLock);
+    mFrames.clearRange(uptr(frame) / memory::pageSize, count);
 }
 
 void
 FrameAllocator::reserveRange(u32 start,
                              u32 length)
 {
-    // TODO: `start` and `length` validation.
-    const u32 pagesPerBitmap = Bitmap::length;
-
     const u32 startPage = memory::pageAlignDown(start) / memory::pageSize;
     const u32 endPage = memory::pageAlignUp(start + length) / memory::pageSize;
 
-    // Iterators
-    u32 page = startPage;
-    u32 bitmapIndex = startPage / pagesPerBitmap;
-    u8 bitmapOffset = startPage % pagesPerBitmap;
-
-    kstd::printFormat("Reserving %ld pages for memory addresses between 0x%08lX and 0x%08lX\n", endPage - startPage, start, start + length);
-
-    // Fill in any entries that aren't aligned to pagesPerBitmap at the beginning.
-    while (bitmapOffset != 0) {
-        mBitmap[bitmapIndex].set(bitmapOffset);
-        bitmapOffset = (bitmapOffset + 1) % 8;
-        page++;
-        if (bitmapOffset == 0) {
-            bitmapIndex++;
-        }
-    }
-
-    // Fill in entries in `pagesPerBitmap` sized chunks.
-    while ((endPage - page) >= pagesPerBitmap) {
-        mBitmap[bitmapIndex++].fill();
-        page += pagesPerBitmap;
-    }
+    kstd::print("Reserving {} pages for memory addresses between 0x{:08X} and 0x{:08X}\n", endPage - startPage, start, start + length);
 
-    // Fill in any entries that aren't aligned to `pagesPerBitmap` at the end of the range.
-    while ((endPage - page) > 0) {
-        mBitmap[bitmapIndex].set(bitmapOffset);
-        bitmapOffset = (bitmapOffset + 1) % 8;
-        page++;
-    }
+    // Ranges past the end of memory are clamped by the span.
+    mFrames.setRange(startPage, endPage - startPage);
 }
 
 inline void*
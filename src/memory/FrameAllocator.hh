@@ -11,7 +11,8 @@
 #define __MEMORY_FRAMEALLOCATOR_HH__
 
 #include "StartupInformation.hh"
-#include "kstd/Bitmap.hh"
+#include "kstd/BitSet.hh"
+#include "kstd/SpinLock.hh"
 #include "kstd/Types.hh"
 
 namespace kernel {
@@ -32,14 +33,20 @@ struct FrameAllocator
      */
     void* allocate();
 
-    // TODO: free()
+    /**
+     * Allocate `count` physically contiguous page frames, and return the
+     * address of the first.
+     */
+    void* allocateContiguous(usize count);
 
-private:
-    typedef kstd::Bitmap<u8> Bitmap;
+    /** Free `count` page frames starting at `frame`, which came from one of the allocate methods. */
+    void free(void* frame, usize count = 1);
 
-    /** Starting address of the frame allocation bitmap. */
-    Bitmap* mBitmap;
-    /** Size of the bitmap in `sizeof(Bitmap)` units. */
+private:
+    kstd::SpinLock mLock;
+    /** One bit per page frame. A set bit means the frame is in use. */
+    kstd::BitSpan mFrames;
+    /** Size of the frame bitmap in bytes. */
     u32 mBitmapSize;
     /** Total number of pages. */
     u32 mNumberOfPages;
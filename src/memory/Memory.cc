@@ -6,6 +6,10 @@
  * Top-level classes for managing system memory.
  */
 
+#include "Kernel.hh"
+#include "PerCPU.hh"
+#include "kstd/Format.hh"
+#include "kstd/Memory.hh"
 #include "kstd/PrintFormat.hh"
 #include "memory/Memory.hh"
 
@@ -25,19 +29,41 @@ MemoryManager::initialize(const StartupInformation& startupInformation)
 {
     auto multiboot = startupInformation.multibootInformation;
     kstd::printFormat("Memory map:\n");
-    kstd::printFormat("  available: lower = %ld KB, upper = %ld KB, total = %ld KB\n",
-                      multiboot->lowerMemoryKB(), multiboot->upperMemoryKB(),
-                      startupInformation.memorySize() / 1024);
+    kstd::print("  available: lower = {} KB, upper = {} KB, total = {} KB\n",
+                multiboot->lowerMemoryKB(), multiboot->upperMemoryKB(),
+                startupInformation.memorySize() / 1024);
     for (auto it = multiboot->memoryMapBegin(); it != multiboot->memoryMapEnd(); ++it) {
         auto begin = (*it).base;
         auto end = begin + (*it).length - 1;
-        kstd::printFormat("  begin = 0x%08llX, end = 0x%08llX (%s)\n", begin, end,
-                          (*it).type == 1 ? "available" : "reserved");
+        kstd::print("  begin = 0x{:08X}, end = 0x{:08X} ({})\n", begin, end,
+                    (*it).type == 1 ? "available" : "reserved");
     }
 
     initializeGDT();
     mFrameAllocator.initialize(startupInformation);
     mPageAllocator.initialize(startupInformation, &mFrameAllocator);
+
+    // Off the per-CPU template, before anything gets a chance to write to it.
+    if (!initializePerCPU(0)) {
+        Kernel::systemKernel().panic("Couldn't allocate the boot CPU's per-CPU data\n");
+    }
+    x86::loadPerCPUArea(0);
+}
+
+
+bool
+MemoryManager::initializePerCPU(usize cpu)
+{
+    const usize pages = memory::pageAlignUp(x86::perCPUSize()) / memory::pageSize;
+    void* area = mFrameAllocator.allocateContiguous(pages);
+    if (!area) {
+        return false;
+    }
+    // Frames come back with whatever was in them. The template only covers
+    // perCPUSize() bytes of this; nothing past it should look like data.
+    kstd::Memory::zero(area, pages * memory::pageSize);
+    x86::initializePerCPUArea(cpu, area, mGDT);
+    return true;
 }
 
 /*
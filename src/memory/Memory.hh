@@ -24,6 +24,17 @@ struct MemoryManager
 
     void initialize(const StartupInformation& startupInformation);
 
+    FrameAllocator& frameAllocator() { return mFrameAllocator; }
+
+    /**
+     * Make CPU `cpu`'s copy of the per-CPU data, and its per-CPU segment.
+     * `cpu` then loads it with x86::loadPerCPUArea(). The boot CPU's is made
+     * by initialize().
+     *
+     * @return `false` if there wasn't memory for it.
+     */
+    bool initializePerCPU(usize cpu);
+
 private:
     x86::GDT mGDT;
     FrameAllocator mFrameAllocator;
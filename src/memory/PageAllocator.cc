@@ -8,8 +8,8 @@
 
 #include "Attributes.hh"
 #include "kstd/Bitmap.hh"
+#include "kstd/Format.hh"
 #include "kstd/Memory.hh"
-#include "kstd/PrintFormat.hh"
 #include "memory/Memory.hh"
 #include "memory/PageAllocator.hh"
 
@@ -118,7 +118,7 @@ PageAllocator::initialize(const StartupInformation& startupInformation,
                           FrameAllocator* frameAllocator)
 {
     mPageDirectory = reinterpret_cast<PageDirectoryEntry*>(frameAllocator->allocate());
-    kstd::printFormat("Page directory at 0x%08lX\n", uptr(mPageDirectory));
+    kstd::print("Page directory at 0x{:08X}\n", uptr(mPageDirectory));
     kstd::Memory::zero(mPageDirectory, memory::pageSize * (memory::pageSize / sizeof(PageDirectoryEntry)));
 
     auto& firstPageTable = mPageDirectory[0];
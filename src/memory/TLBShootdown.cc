@@ -0,0 +1,79 @@
+/* TLBShootdown.cc
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Batched TLB invalidation across CPUs.
+ */
+
+#include "CPU.hh"
+#include "CrossCall.hh"
+#include "memory/Memory.hh"
+#include "memory/TLBShootdown.hh"
+
+namespace kernel {
+
+/*
+ * Public
+ */
+
+TLBShootdown::TLBShootdown(u32 cpus)
+    : mCPUs(cpus),
+      mCount(0),
+      mIsFullFlush(false)
+{ }
+
+
+TLBShootdown::~TLBShootdown()
+{
+    flush();
+}
+
+
+void
+TLBShootdown::add(uptr address,
+                  usize pages)
+{
+    if (mIsFullFlush) {
+        return;
+    }
+    if (pages > FullFlushThreshold - mCount) {
+        mIsFullFlush = true;
+        return;
+    }
+    address = memory::pageAlignDown(address);
+    for (usize i = 0; i < pages; i++) {
+        mPages[mCount++] = address + i * memory::pageSize;
+    }
+}
+
+
+void
+TLBShootdown::flush()
+{
+    if (isEmpty()) {
+        return;
+    }
+    CrossCall::systemCrossCall().call(mCPUs, invalidate, this);
+    mCount = 0;
+    mIsFullFlush = false;
+}
+
+/*
+ * Private
+ */
+
+void
+TLBShootdown::invalidate(void* argument)
+{
+    const auto& self = *static_cast<const TLBShootdown*>(argument);
+    if (self.mIsFullFlush) {
+        x86::flushTLB();
+        return;
+    }
+    for (usize i = 0; i < self.mCount; i++) {
+        x86::invalidatePage(self.mPages[i]);
+    }
+}
+
+} /* namespace kernel */
@@ -0,0 +1,74 @@
+/* TLBShootdown.hh
+ * vim: set tw=80:
+ * Eryn Wells <eryn@erynwells.me>
+ */
+/**
+ * Keeping other CPUs' TLBs in step with the page tables.
+ *
+ * A CPU can cache a translation for as long as the address space it's in is
+ * loaded, so after a mapping is changed or removed, every CPU with that address
+ * space active has to drop it, and the memory it pointed to can't be reused
+ * until they have. Doing that a page at a time costs an IPI round per page.
+ * Instead, collect the pages in a TLBShootdown and flush them all in one round:
+ *
+ *     TLBShootdown shootdown(cpusUsingAddressSpace);
+ *     for (...) {
+ *         // ...clear the entry...
+ *         shootdown.add(address);
+ *     }
+ *     shootdown.flush();
+ *     // Now the frames can go back to the frame allocator.
+ *
+ * Past FullFlushThreshold pages, reloading CR3 is cheaper than invalidating
+ * them one by one, so the batch becomes a full flush.
+ */
+
+#ifndef __MEMORY_TLBSHOOTDOWN_HH__
+#define __MEMORY_TLBSHOOTDOWN_HH__
+
+#include "kstd/Types.hh"
+
+namespace kernel {
+
+struct TLBShootdown
+{
+    /** Most pages invalidated one by one. Any more and the whole TLB goes. */
+    static const usize FullFlushThreshold = 32;
+
+    /**
+     * Start a batch for an address space that's active on `cpus`, a bit mask
+     * of CPU numbers. Only those CPUs are interrupted.
+     */
+    explicit TLBShootdown(u32 cpus);
+
+    /** Flushes anything still pending. */
+    ~TLBShootdown();
+
+    /** Add `pages` pages, starting at the page holding `address`. */
+    void add(uptr address, usize pages = 1);
+
+    /**
+     * Invalidate everything added so far on every CPU in the set, this one
+     * included, and wait for them to finish. The batch is empty afterward,
+     * and can be reused.
+     */
+    void flush();
+
+    bool isEmpty() const { return mCount == 0 && !mIsFullFlush; }
+
+private:
+    u32 mCPUs;
+    usize mCount;
+    bool mIsFullFlush;
+    uptr mPages[FullFlushThreshold];
+
+    /** Runs on each CPU in the set. */
+    static void invalidate(void* argument);
+
+    TLBShootdown(const TLBShootdown& other) = delete;
+    TLBShootdown& operator=(const TLBShootdown& other) = delete;
+};
+
+} /* namespace kernel */
+
+#endif /* __MEMORY_TLBSHOOTDOWN_HH__ */